@@ -0,0 +1,342 @@
+#include "common.h"
+
+#include <dirent.h>
+
+/* tty-snd-batch:
+        analyse a whole corpus in one process and write one CSV row per file: the file, its
+        duration, the mean F0, the means of the formants and their bandwidths and the
+        frequencies of the highest peaks of its spectrum. This is what run_on_wavs.sh collects
+        with one Praat run per measurement; arguments are wav files or directories, which are
+        searched for *.wav
+
+        -t threads        number of files analysed at once (default: all cores)
+        -c channel        channel to analyse (default 0)
+        -l file           read more file names from file, one per line ("-" for stdin)
+        -o file           write the CSV to file instead of stdout
+        -m Hz             maximum formant (default 5500)
+        -n number         number of formants (default 5)
+        -f                fast mode formants: peaks of the LPC envelope instead of root solving
+        -p steps          number of cutoff steps of the peak search (default 20)
+        -d cents          minimum distance of two peaks (default 20)
+        -k number         number of peaks written, highest first (default 5)
+
+        Files are handed to the thread pool largest first, every thread keeps its analysis
+        buffers from file to file, and the rows are written in the order the files were given.
+*/
+
+typedef struct batch_file_list_t {
+    char** names;
+    size_t nr_files;
+    size_t capacity;
+} batch_file_list_t;
+
+static void push_file(batch_file_list_t* list, const char* name) {
+    if(list[0].nr_files == list[0].capacity) {
+        size_t new_capacity = (list[0].capacity == 0) ? 64 : 2*list[0].capacity;
+        char** new_names = realloc(list[0].names, new_capacity*sizeof(char*));
+        if(new_names == NULL) die("out of memory growing file list!\n");
+        list[0].names = new_names;
+        list[0].capacity = new_capacity;
+    }
+    list[0].names[list[0].nr_files] = strdup(name);
+    list[0].nr_files++;
+}
+
+static int string_cmp_qsort(const void* pa, const void* pb) {
+    return strcmp(((char* const*) pa)[0], ((char* const*) pb)[0]);
+}
+
+static bool has_wav_extension(const char* name) {
+    size_t len = strlen(name);
+    return len > 4 && (strcmp(&name[len-4], ".wav") == 0 || strcmp(&name[len-4], ".WAV") == 0);
+}
+
+/* a directory contributes its *.wav files in name order, anything else is taken as a file */
+static void add_path(batch_file_list_t* list, const char* path) {
+    DIR* dir = opendir(path);
+    if(dir == NULL) {
+        push_file(list, path);
+        return;
+    }
+    size_t first = list[0].nr_files;
+    struct dirent* entry;
+    while((entry = readdir(dir)) != NULL) {
+        if(!has_wav_extension(entry->d_name)) continue;
+        size_t len = strlen(path) + 1 + strlen(entry->d_name) + 1;
+        char* full_name = malloc(len);
+        snprintf(full_name, len, "%s/%s", path, entry->d_name);
+        push_file(list, full_name);
+        free(full_name);
+    }
+    closedir(dir);
+    qsort(&list[0].names[first], list[0].nr_files - first, sizeof(char*), string_cmp_qsort);
+}
+
+static void add_list_file(batch_file_list_t* list, const char* list_name) {
+    FILE* fp = (strcmp(list_name, "-") == 0) ? stdin : fopen(list_name, "r");
+    if(fp == NULL) die("could not open file list!\n");
+    char line[4096];
+    while(fgets(line, sizeof(line), fp) != NULL) {
+        size_t len = strcspn(line, "\r\n");
+        line[len] = '\0';
+        if(len > 0) add_path(list, line);
+    }
+    if(fp != stdin) fclose(fp);
+}
+
+
+
+/* everything one thread needs for a file; the buffers only grow, so after the first few
+   files nothing is allocated except the tracks themselves */
+typedef struct batch_workspace_t {
+    formant_track_workspace_t formants;
+    pitch_workspace_t pitch;
+    peak_finder_t peaks;
+    size_t sound_capacity;
+    float* sound;      /* the channel as floats */
+    size_t spectrum_capacity;
+    float* spectrum;   /* complex, power of two length */
+    float* fft_work;
+} batch_workspace_t;
+
+typedef struct batch_job_t {
+    const batch_file_list_t* files;
+    const size_t* order; /* job number -> file number, largest files first */
+    int channel;
+    formant_track_params_t formant_params;
+    pitch_params_t pitch_params;
+    float cutoff_step;
+    int min_cents_difference;
+    int nr_peaks;
+    batch_workspace_t* workspaces;
+    /* results, one row per file */
+    double* durations;
+    double* f0s;
+    double* formant_freqs; /* nr_files x nr_formants */
+    double* formant_bws;
+    float* peak_freqs;     /* nr_files x nr_peaks, NAN where there are fewer peaks */
+} batch_job_t;
+
+static void analyze_peaks(batch_job_t* job, batch_workspace_t* workspace, const float* sound, size_t len, double sample_rate, float* peaks_out) {
+    for(int k = 0; k < job[0].nr_peaks; k++) peaks_out[k] = NAN;
+    size_t fft_len = truncate_power_of_2(len);
+    if(fft_len < 4) return;
+
+    if(fft_len > workspace[0].spectrum_capacity) {
+        free(workspace[0].spectrum);
+        free(workspace[0].fft_work);
+        destroy_peak_finder(&workspace[0].peaks);
+        workspace[0].spectrum = malloc(2*fft_len*sizeof(float));
+        workspace[0].fft_work = malloc(fft_batch_work_size(2*fft_len)*sizeof(float));
+        workspace[0].peaks = create_peak_finder(fft_len);
+        workspace[0].spectrum_capacity = fft_len;
+    }
+    /* the tty-snd-wav | tty-snd-fft 0 0 | tty-snd-peaks chain, without the pipes */
+    float* spectrum = workspace[0].spectrum;
+    for(size_t i = 0; i < fft_len; i++) {
+        spectrum[2*i] = sound[i];
+        spectrum[2*i+1] = 0.0f;
+    }
+    fft_power_of_two_batch_f(spectrum, spectrum, 2*fft_len, 1, false, workspace[0].fft_work);
+
+    peak_t* peaks;
+    size_t nr_peaks = find_spectrum_peaks(&workspace[0].peaks, spectrum, fft_len, sample_rate, job[0].cutoff_step, job[0].min_cents_difference, &peaks);
+    for(size_t i = 0; i < nr_peaks; i++) {
+        if(peaks[i].freq == -1.0f || peaks[i].formant_nr >= job[0].nr_peaks) continue;
+        peaks_out[peaks[i].formant_nr] = peaks[i].freq;
+    }
+    free(peaks);
+}
+
+static void analyze_file(void* ctx, int thread_nr, size_t job_nr) {
+    batch_job_t* job = ctx;
+    batch_workspace_t* workspace = &job[0].workspaces[thread_nr];
+    size_t file_nr = job[0].order[job_nr];
+    int nr_formants = job[0].formant_params.nr_formants;
+
+    waveform_t form = read_amplitude_data(job[0].files[0].names[file_nr], job[0].channel);
+    double sample_rate = form.samples_per_second;
+    size_t len = form.data_length;
+
+    if(len > workspace[0].sound_capacity) {
+        free(workspace[0].sound);
+        workspace[0].sound = malloc(len*sizeof(float));
+        if(workspace[0].sound == NULL) die("out of memory for batch workspace!\n");
+        workspace[0].sound_capacity = len;
+    }
+    float* sound = workspace[0].sound;
+    for(size_t i = 0; i < len; i++) sound[i] = form.amplitude_data[i];
+    destroy_waveform(&form);
+
+    job[0].durations[file_nr] = len/sample_rate;
+
+    pitch_track_t pitch = track_pitch_with(&workspace[0].pitch, sound, 1, len, sample_rate, &job[0].pitch_params);
+    job[0].f0s[file_nr] = pitch_track_mean(&pitch);
+    destroy_pitch_track(&pitch);
+
+    double* freqs = &job[0].formant_freqs[file_nr*nr_formants];
+    double* bws = &job[0].formant_bws[file_nr*nr_formants];
+    formant_track_t track = track_formants_with(&workspace[0].formants, sound, 1, len, sample_rate, &job[0].formant_params);
+    if(track.nr_frames > 0) {
+        formant_track_means(&track, freqs, bws);
+    } else {
+        for(int k = 0; k < nr_formants; k++) freqs[k] = bws[k] = NAN;
+    }
+    destroy_formant_track(&track);
+
+    analyze_peaks(job, workspace, sound, len, sample_rate, &job[0].peak_freqs[file_nr*job[0].nr_peaks]);
+}
+
+
+
+static const size_t* g_file_sizes; /* for the qsort below */
+
+static int larger_file_first_cmp_qsort(const void* pa, const void* pb) {
+    size_t a = ((const size_t*) pa)[0], b = ((const size_t*) pb)[0];
+    if(g_file_sizes[a] != g_file_sizes[b]) return (g_file_sizes[a] < g_file_sizes[b]) ? 1 : -1;
+    return (a < b) ? -1 : (a > b);
+}
+
+/* quoted if it contains anything that would break the row */
+static void write_csv_name(FILE* fp, const char* name) {
+    if(strpbrk(name, ",\"\n") == NULL) {
+        fprintf(fp, "%s", name);
+        return;
+    }
+    fputc('"', fp);
+    for(const char* c = name; *c != '\0'; c++) {
+        if(*c == '"') fputc('"', fp);
+        fputc(*c, fp);
+    }
+    fputc('"', fp);
+}
+
+static void write_csv(FILE* fp, const batch_job_t* job) {
+    int nr_formants = job[0].formant_params.nr_formants;
+    fprintf(fp, "file,duration,F0");
+    for(int k = 0; k < nr_formants; k++) fprintf(fp, ",F%i,B%i", k+1, k+1);
+    for(int k = 0; k < job[0].nr_peaks; k++) fprintf(fp, ",peak%i", k+1);
+    fprintf(fp, "\n");
+
+    for(size_t f = 0; f < job[0].files[0].nr_files; f++) {
+        write_csv_name(fp, job[0].files[0].names[f]);
+        fprintf(fp, ",%f,%f", job[0].durations[f], job[0].f0s[f]);
+        for(int k = 0; k < nr_formants; k++) {
+            fprintf(fp, ",%f,%f", job[0].formant_freqs[f*nr_formants + k], job[0].formant_bws[f*nr_formants + k]);
+        }
+        for(int k = 0; k < job[0].nr_peaks; k++) {
+            fprintf(fp, ",%f", job[0].peak_freqs[f*job[0].nr_peaks + k]);
+        }
+        fprintf(fp, "\n");
+    }
+}
+
+
+
+int main(int argc, char** argv) {
+    batch_file_list_t files = {0};
+    batch_job_t job = {0};
+    init_formant_track_params(&job.formant_params);
+    init_pitch_params(&job.pitch_params);
+    int nr_threads = default_thread_count();
+    int nr_steps = 20;
+    job.min_cents_difference = 20;
+    job.nr_peaks = 5;
+    const char* output_name = NULL;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-f") == 0) {
+            job.formant_params.fast = true;
+        } else if(i+1 < argc && strcmp(argv[i], "-t") == 0) {
+            nr_threads = atoi(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-c") == 0) {
+            job.channel = atoi(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-l") == 0) {
+            add_list_file(&files, argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-o") == 0) {
+            output_name = argv[++i];
+        } else if(i+1 < argc && strcmp(argv[i], "-m") == 0) {
+            job.formant_params.max_formant = atof(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-n") == 0) {
+            job.formant_params.nr_formants = atoi(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-p") == 0) {
+            nr_steps = atoi(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-d") == 0) {
+            job.min_cents_difference = atoi(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-k") == 0) {
+            job.nr_peaks = atoi(argv[++i]);
+        } else if(argv[i][0] != '-') {
+            add_path(&files, argv[i]);
+        } else {
+            die("usage: tty-snd-batch [-t threads] [-c channel] [-l file-list] [-o output] [-m max-formant] [-n nr-formants] [-f] [-p peak-steps] [-d min-cents] [-k nr-peaks] files-or-directories...\n");
+        }
+    }
+    assert(job.formant_params.max_formant > 0 && job.formant_params.nr_formants > 0);
+    assert(nr_steps > 1 && job.nr_peaks >= 0 && job.channel >= 0);
+    job.cutoff_step = 1.0f/nr_steps;
+    if(nr_threads < 1) nr_threads = 1;
+    if(nr_threads > MAX_THREADS) nr_threads = MAX_THREADS;
+    /* the parallelism is over files, every file is analysed by one thread */
+    job.formant_params.nr_threads = 1;
+    job.pitch_params.nr_threads = 1;
+
+    size_t nr_files = files.nr_files;
+    if(nr_files == 0) die("no wav files given!\n");
+
+    size_t* file_sizes = malloc(nr_files*sizeof(size_t));
+    size_t* order = malloc(nr_files*sizeof(size_t));
+    for(size_t f = 0; f < nr_files; f++) {
+        FILE* fp = fopen(files.names[f], "rb");
+        if(fp == NULL) {
+            fprintf(stderr, "could not open %s\n", files.names[f]);
+            die("unreadable file in the batch!\n");
+        }
+        fclose(fp);
+        file_sizes[f] = filesize(files.names[f]);
+        order[f] = f;
+    }
+    g_file_sizes = file_sizes;
+    qsort(order, nr_files, sizeof(size_t), larger_file_first_cmp_qsort);
+
+    int nr_formants = job.formant_params.nr_formants;
+    job.files = &files;
+    job.order = order;
+    job.durations = malloc(nr_files*sizeof(double));
+    job.f0s = malloc(nr_files*sizeof(double));
+    job.formant_freqs = malloc(nr_files*nr_formants*sizeof(double));
+    job.formant_bws = malloc(nr_files*nr_formants*sizeof(double));
+    job.peak_freqs = malloc((nr_files*job.nr_peaks + 1)*sizeof(float));
+    job.workspaces = calloc(nr_threads, sizeof(batch_workspace_t));
+    for(int t = 0; t < nr_threads; t++) {
+        job.workspaces[t].formants = create_formant_track_workspace(1);
+        job.workspaces[t].pitch = create_pitch_workspace(1);
+    }
+
+    parallel_for(nr_files, nr_threads, analyze_file, &job);
+
+    FILE* fp = (output_name == NULL) ? stdout : fopen(output_name, "w");
+    if(fp == NULL) die("could not open output file!\n");
+    write_csv(fp, &job);
+    if(fp != stdout) fclose(fp);
+
+    for(int t = 0; t < nr_threads; t++) {
+        destroy_formant_track_workspace(&job.workspaces[t].formants);
+        destroy_pitch_workspace(&job.workspaces[t].pitch);
+        if(job.workspaces[t].spectrum_capacity > 0) destroy_peak_finder(&job.workspaces[t].peaks);
+        free(job.workspaces[t].sound);
+        free(job.workspaces[t].spectrum);
+        free(job.workspaces[t].fft_work);
+    }
+    free(job.workspaces);
+    free(job.durations);
+    free(job.f0s);
+    free(job.formant_freqs);
+    free(job.formant_bws);
+    free(job.peak_freqs);
+    free(file_sizes);
+    free(order);
+    for(size_t f = 0; f < nr_files; f++) free(files.names[f]);
+    free(files.names);
+
+    return 0;
+}
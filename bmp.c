@@ -0,0 +1,101 @@
+#include "common.h"
+
+/*
+ * Uncompressed BMP files, 24 bit, or 32 bit with the alpha in the fourth byte of a pixel
+ * (plain BI_RGB, which many viewers show as opaque). A bitmap stream writes the header
+ * with the height still open and takes the rows one strip at a time, top to bottom, straight
+ * to the file; closing it fills in the height. So an image of any height is written without
+ * ever being in memory as a whole, and only the row strip being written has to be.
+ */
+
+static void put_u16(uint8_t* dest, uint16_t value) {
+    dest[0] = value & 0xff;
+    dest[1] = value >> 8;
+}
+
+static void put_u32(uint8_t* dest, uint32_t value) {
+    for(int i = 0; i < 4; i++) {
+        dest[i] = (value >> (8*i)) & 0xff;
+    }
+}
+
+#define BMP_HEADER_SIZE 54
+
+/* the bytes of a row in the file, padded to four */
+size_t bitmap_row_size(int width, bool has_alpha) {
+    size_t bytes = (size_t) width*(has_alpha ? 4 : 3);
+    return (bytes + 3) & ~(size_t) 3;
+}
+
+static void fill_bitmap_header(uint8_t* header, int width, int height, int bytes_per_pixel, float DPI) {
+    /* a negative height is a top-down bitmap, the first row in the file is the top one */
+    size_t image_size = bitmap_row_size(width, bytes_per_pixel == 4)*height;
+    int32_t ppm = (int32_t) lround(DPI/0.0254);
+    memset(header, 0, BMP_HEADER_SIZE);
+    header[0] = 'B';
+    header[1] = 'M';
+    put_u32(&header[2], (uint32_t)(BMP_HEADER_SIZE + image_size));
+    put_u32(&header[10], BMP_HEADER_SIZE);
+    put_u32(&header[14], 40);
+    put_u32(&header[18], (uint32_t) width);
+    put_u32(&header[22], (uint32_t)(-height));
+    put_u16(&header[26], 1);
+    put_u16(&header[28], (uint16_t)(8*bytes_per_pixel));
+    put_u32(&header[34], (uint32_t) image_size);
+    put_u32(&header[38], (uint32_t) ppm);
+    put_u32(&header[42], (uint32_t) ppm);
+}
+
+void open_bitmap_stream(bitmap_stream_t* bmp, const char* file_name, int width, bool has_alpha, float DPI) {
+    assert(width > 0);
+    bmp[0].fp = fopen(file_name, "wb");
+    if(bmp[0].fp == NULL) die("could not open the bitmap file!\n");
+    bmp[0].width = width;
+    bmp[0].height = 0;
+    bmp[0].bytes_per_pixel = has_alpha ? 4 : 3;
+    bmp[0].row_size = bitmap_row_size(width, has_alpha);
+    bmp[0].DPI = DPI;
+
+    uint8_t header[BMP_HEADER_SIZE];
+    fill_bitmap_header(header, width, 0, bmp[0].bytes_per_pixel, DPI);
+    if(fwrite(header, 1, BMP_HEADER_SIZE, bmp[0].fp) != BMP_HEADER_SIZE) die("could not write the bitmap header!\n");
+}
+
+/* nr_rows rows of row_size bytes each, in the pixel layout of the file: blue, green, red(, alpha) */
+void write_bitmap_rows(bitmap_stream_t* bmp, const uint8_t* rows, int nr_rows) {
+    if(fwrite(rows, bmp[0].row_size, nr_rows, bmp[0].fp) != (size_t) nr_rows) die("could not write the bitmap rows!\n");
+    bmp[0].height += nr_rows;
+}
+
+void close_bitmap_stream(bitmap_stream_t* bmp) {
+    uint8_t header[BMP_HEADER_SIZE];
+    fill_bitmap_header(header, bmp[0].width, bmp[0].height, bmp[0].bytes_per_pixel, bmp[0].DPI);
+    if(fseek(bmp[0].fp, 0, SEEK_SET) != 0 || fwrite(header, 1, BMP_HEADER_SIZE, bmp[0].fp) != BMP_HEADER_SIZE) {
+        die("could not complete the bitmap header!\n");
+    }
+    fclose(bmp[0].fp);
+    bmp[0].fp = NULL;
+}
+
+/* an image of separate color planes of width*height bytes each, the top row first; without
+   alpha_data the file is 24 bit */
+void write_bitmap_data(char* file_name, uint8_t* red_data, uint8_t* green_data, uint8_t* blue_data, uint8_t* alpha_data, size_t len, int width, int height, float DPI) {
+    assert(width > 0 && height >= 0 && len >= (size_t) width*height);
+    bitmap_stream_t bmp;
+    open_bitmap_stream(&bmp, file_name, width, alpha_data != NULL, DPI);
+
+    uint8_t* row = calloc(bmp.row_size, 1);
+    int bpp = bmp.bytes_per_pixel;
+    for(int y = 0; y < height; y++) {
+        size_t base = (size_t) y*width;
+        for(int x = 0; x < width; x++) {
+            row[bpp*x] = blue_data[base+x];
+            row[bpp*x+1] = green_data[base+x];
+            row[bpp*x+2] = red_data[base+x];
+            if(bpp == 4) row[bpp*x+3] = alpha_data[base+x];
+        }
+        write_bitmap_rows(&bmp, row, 1);
+    }
+    free(row);
+    close_bitmap_stream(&bmp);
+}
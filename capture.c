@@ -0,0 +1,295 @@
+#include "common.h"
+
+#include <unistd.h>
+
+/*
+ * Continuous microphone capture. A capture thread drains the device every period and pushes
+ * the frames, as the device delivers them, into a single-producer single-consumer ring; the
+ * consumer takes them out through capture_read, which sleeps on a semaphore the capture thread
+ * posts after every period. Neither side ever takes a lock, and neither side spins: the
+ * capture thread sleeps for the time the missing frames take to arrive, the consumer until
+ * the next period is in.
+ *
+ * If the consumer falls behind by more than the ring holds, the newest frames are dropped and
+ * counted, so a slow consumer shows up as a gap in the stream instead of growing memory.
+ */
+
+void init_frame_ring(frame_ring_t* ring, size_t frame_size, size_t min_frames) {
+    size_t capacity = 1;
+    while(capacity < min_frames) capacity <<= 1;
+    ring[0].frame_size = frame_size;
+    ring[0].capacity = capacity;
+    ring[0].data = malloc(capacity*frame_size);
+    if(ring[0].data == NULL) die("out of memory for frame ring!\n");
+    atomic_init(&ring[0].write_pos, 0);
+    atomic_init(&ring[0].read_pos, 0);
+}
+
+void destroy_frame_ring(frame_ring_t* ring) {
+    free(ring[0].data);
+    ring[0].data = NULL;
+    ring[0].capacity = 0;
+}
+
+/* producer side; returns the number of frames that fit */
+size_t frame_ring_write(frame_ring_t* ring, const void* frames, size_t nr_frames) {
+    size_t write_pos = atomic_load_explicit(&ring[0].write_pos, memory_order_relaxed);
+    size_t read_pos = atomic_load_explicit(&ring[0].read_pos, memory_order_acquire);
+    size_t space = ring[0].capacity - (write_pos - read_pos);
+    if(nr_frames > space) nr_frames = space;
+
+    /* the positions run freely, the slot is the position modulo the capacity */
+    size_t slot = write_pos & (ring[0].capacity-1);
+    size_t first = ring[0].capacity - slot;
+    if(first > nr_frames) first = nr_frames;
+    const uint8_t* src = frames;
+    memcpy(&ring[0].data[slot*ring[0].frame_size], src, first*ring[0].frame_size);
+    memcpy(ring[0].data, &src[first*ring[0].frame_size], (nr_frames-first)*ring[0].frame_size);
+
+    atomic_store_explicit(&ring[0].write_pos, write_pos + nr_frames, memory_order_release);
+    return nr_frames;
+}
+
+/* consumer side; returns the number of frames read, at most max_frames */
+size_t frame_ring_read(frame_ring_t* ring, void* frames, size_t max_frames) {
+    size_t read_pos = atomic_load_explicit(&ring[0].read_pos, memory_order_relaxed);
+    size_t write_pos = atomic_load_explicit(&ring[0].write_pos, memory_order_acquire);
+    size_t nr_frames = write_pos - read_pos;
+    if(nr_frames > max_frames) nr_frames = max_frames;
+
+    size_t slot = read_pos & (ring[0].capacity-1);
+    size_t first = ring[0].capacity - slot;
+    if(first > nr_frames) first = nr_frames;
+    uint8_t* dest = frames;
+    memcpy(dest, &ring[0].data[slot*ring[0].frame_size], first*ring[0].frame_size);
+    memcpy(&dest[first*ring[0].frame_size], ring[0].data, (nr_frames-first)*ring[0].frame_size);
+
+    atomic_store_explicit(&ring[0].read_pos, read_pos + nr_frames, memory_order_release);
+    return nr_frames;
+}
+
+size_t frame_ring_available(frame_ring_t* ring) {
+    return atomic_load_explicit(&ring[0].write_pos, memory_order_acquire) - atomic_load_explicit(&ring[0].read_pos, memory_order_acquire);
+}
+
+
+
+/* AL_FORMAT_{MONO,STEREO}{16,_FLOAT32}; the float formats are only there with AL_EXT_FLOAT32 */
+ALenum al_sample_format(sample_format_t format) {
+    assert(format.channels == 1 || format.channels == 2);
+    if(format.is_float) {
+        return (format.channels == 1) ? AL_FORMAT_MONO_FLOAT32 : AL_FORMAT_STEREO_FLOAT32;
+    }
+    return (format.channels == 1) ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16;
+}
+
+size_t sample_frame_size(sample_format_t format) {
+    return format.channels*(format.is_float ? sizeof(float) : sizeof(int16_t));
+}
+
+/* mixes the channels down to out[i*stride], full scale 1 */
+void frames_to_mono(const void* frames, size_t nr_frames, sample_format_t format, float* out, size_t stride) {
+    int channels = format.channels;
+    if(format.is_float) {
+        const float* in = frames;
+        if(channels == 1) {
+            for(size_t i = 0; i < nr_frames; i++) out[i*stride] = in[i];
+        } else {
+            for(size_t i = 0; i < nr_frames; i++) out[i*stride] = 0.5f*(in[2*i] + in[2*i+1]);
+        }
+    } else {
+        const int16_t* in = frames;
+        if(channels == 1) {
+            for(size_t i = 0; i < nr_frames; i++) out[i*stride] = in[i]*(1.0f/32768.0f);
+        } else {
+            for(size_t i = 0; i < nr_frames; i++) out[i*stride] = ((float) in[2*i] + (float) in[2*i+1])*(0.5f/32768.0f);
+        }
+    }
+}
+
+
+
+/* opens capture device dev_nr (of the ALC_CAPTURE_DEVICE_SPECIFIER list) with room for
+   buffer_frames; a float format the implementation refuses falls back to 16 bit, and format
+   is updated to what was opened. NULL if there is no such device */
+ALCdevice* open_capture_device(int dev_nr, int rate, sample_format_t* format, size_t buffer_frames) {
+    const char* capture_dev_string = alcGetString(NULL, ALC_CAPTURE_DEVICE_SPECIFIER);
+
+    int num;
+    char** devs = split(capture_dev_string, strlen(capture_dev_string), '\0', &num);
+    if(dev_nr < 0 || dev_nr >= num) {
+        for(int i = 0; i < num; i++) free(devs[i]);
+        free(devs);
+        return NULL;
+    }
+
+    fprintf(stderr, "chosen dev: %s\n", devs[dev_nr]);
+
+    ALCdevice* capture = NULL;
+    if(format[0].is_float) {
+        capture = alcCaptureOpenDevice(devs[dev_nr], rate, al_sample_format(format[0]), buffer_frames);
+        if(capture == NULL) {
+            fprintf(stderr, "no float capture (AL_EXT_FLOAT32), falling back to 16 bit\n");
+            format[0].is_float = false;
+        }
+    }
+    if(capture == NULL) {
+        capture = alcCaptureOpenDevice(devs[dev_nr], rate, al_sample_format(format[0]), buffer_frames);
+    }
+
+    for(int i = 0; i < num; i++) {
+        free(devs[i]);
+    }
+    free(devs);
+    return capture;
+}
+
+
+
+static void* capture_thread(void* arg) {
+    capture_t* capture = arg;
+    ALCdevice* device = capture[0].device;
+    size_t period = capture[0].period_frames;
+
+    while(atomic_load(&capture[0].running)) {
+        ALCint available = 0;
+        alcGetIntegerv(device, ALC_CAPTURE_SAMPLES, 1, &available);
+        if(alcGetError(device) != ALC_NO_ERROR) {
+            fprintf(stderr, "capture device failed!\n");
+            break;
+        }
+
+        if((size_t) available < period) {
+            /* sleep until the rest of the period should be in, but not for less than a millisecond */
+            double missing = (double)(period - available)/capture[0].sample_rate;
+            useconds_t usec = (useconds_t)(missing*1000000.0);
+            usleep((usec < 1000) ? 1000 : usec);
+            continue;
+        }
+
+        while((size_t) available >= period) {
+            alcCaptureSamples(device, capture[0].period_buffer, period);
+            size_t written = frame_ring_write(&capture[0].ring, capture[0].period_buffer, period);
+            if(written < period) {
+                atomic_fetch_add(&capture[0].dropped_frames, period - written);
+            }
+            available -= period;
+        }
+        sem_post(&capture[0].readable);
+    }
+
+    atomic_store(&capture[0].running, false);
+    sem_post(&capture[0].readable);
+    return NULL;
+}
+
+/* the version for a rendered source: renders a period at a time until the source has played
+   out. Nothing is dropped, a full ring makes the renderer wait for the consumer. With realtime,
+   period n is rendered when a device would deliver it, (n+1) periods after the start, so the
+   frames are as old when they arrive; otherwise it renders as fast as the consumer takes them */
+static void* rendered_capture_thread(void* arg) {
+    capture_t* capture = arg;
+    render_source_t* source = &capture[0].source;
+    size_t period = capture[0].period_frames;
+
+    for(size_t n = 0; atomic_load(&capture[0].running); n++) {
+        if(capture[0].realtime) {
+            double wait = capture[0].start_time + (n+1)*period/capture[0].sample_rate - monotonic_seconds();
+            if(wait > 0) usleep((useconds_t)(wait*1000000.0));
+        }
+        bool playing = source[0].playing(source[0].arg);
+        source[0].render(source[0].arg, capture[0].period_buffer, period);
+        size_t written = 0;
+        while(written < period && atomic_load(&capture[0].running)) {
+            const uint8_t* frames = capture[0].period_buffer;
+            written += frame_ring_write(&capture[0].ring, &frames[written*capture[0].frame_size], period - written);
+            if(written < period) usleep(500);
+        }
+        sem_post(&capture[0].readable);
+        /* the period rendered after the end still holds the tail of a resampler */
+        if(!playing) break;
+    }
+
+    atomic_store(&capture[0].running, false);
+    sem_post(&capture[0].readable);
+    return NULL;
+}
+
+static void init_capture(capture_t* capture, size_t frame_size, double sample_rate, double period, double ring_time) {
+    capture[0].frame_size = frame_size;
+    capture[0].sample_rate = sample_rate;
+    /* a period of a whole number of frames stays that many, whatever the rounding of period */
+    capture[0].period_frames = (size_t) ceil(period*sample_rate - 1e-6);
+    if(capture[0].period_frames < 1) capture[0].period_frames = 1;
+    capture[0].period_buffer = malloc(capture[0].period_frames*frame_size);
+    if(capture[0].period_buffer == NULL) die("out of memory for capture buffer!\n");
+
+    size_t ring_frames = (size_t) ceil(ring_time*sample_rate);
+    if(ring_frames < 2*capture[0].period_frames) ring_frames = 2*capture[0].period_frames;
+    init_frame_ring(&capture[0].ring, frame_size, ring_frames);
+    atomic_init(&capture[0].dropped_frames, 0);
+    atomic_init(&capture[0].running, true);
+    if(sem_init(&capture[0].readable, 0, 0) != 0) die("could not create capture semaphore!\n");
+}
+
+/* starts capturing from an opened capture device with frames of frame_size bytes: the device
+   is drained every period seconds, and the ring holds ring_time seconds for the consumer */
+void start_capture(capture_t* capture, ALCdevice* device, size_t frame_size, double sample_rate, double period, double ring_time) {
+    capture[0].device = device;
+    capture[0].realtime = true;
+    init_capture(capture, frame_size, sample_rate, period, ring_time);
+
+    alcCaptureStart(device);
+    capture[0].start_time = monotonic_seconds();
+    if(alcGetError(device) != ALC_NO_ERROR) die("could not start capture!\n");
+    if(pthread_create(&capture[0].thread, NULL, capture_thread, capture) != 0) die("could not start capture thread!\n");
+}
+
+/* captures a rendered source in periods, in its format; the capture stops by itself once the
+   source has played out. With realtime the rendering is paced like a device, otherwise it runs
+   as fast as the consumer */
+void start_rendered_capture(capture_t* capture, const render_source_t* source, double period, double ring_time, bool realtime) {
+    capture[0].device = NULL;
+    capture[0].source = source[0];
+    capture[0].realtime = realtime;
+    init_capture(capture, sample_frame_size(source[0].format), source[0].rate, period, ring_time);
+
+    capture[0].start_time = monotonic_seconds();
+    if(pthread_create(&capture[0].thread, NULL, rendered_capture_thread, capture) != 0) die("could not start capture thread!\n");
+}
+
+static void render_loopback(void* arg, void* frames, size_t nr_frames) {
+    loopback_render(arg, frames, nr_frames);
+}
+
+static bool loopback_source_playing(void* arg) {
+    return loopback_playing(arg);
+}
+
+/* captures the mix of an opened loopback, until the stream started with loopback_play_stream
+   has played out */
+void start_loopback_capture(capture_t* capture, loopback_t* loopback, double period, double ring_time, bool realtime) {
+    render_source_t source = {render_loopback, loopback_source_playing, loopback, loopback[0].rate, loopback[0].format};
+    start_rendered_capture(capture, &source, period, ring_time, realtime);
+}
+
+/* waits until frames are there and reads up to max_frames of them; returns 0 only once the
+   capture has stopped and the ring is drained */
+size_t capture_read(capture_t* capture, void* frames, size_t max_frames) {
+    while(true) {
+        size_t nr = frame_ring_read(&capture[0].ring, frames, max_frames);
+        if(nr > 0) return nr;
+        if(!atomic_load(&capture[0].running) && frame_ring_available(&capture[0].ring) == 0) return 0;
+        sem_wait(&capture[0].readable);
+    }
+}
+
+void stop_capture(capture_t* capture) {
+    atomic_store(&capture[0].running, false);
+    pthread_join(capture[0].thread, NULL);
+    if(capture[0].device != NULL) alcCaptureStop(capture[0].device);
+    sem_destroy(&capture[0].readable);
+    destroy_frame_ring(&capture[0].ring);
+    free(capture[0].period_buffer);
+    capture[0].period_buffer = NULL;
+}
@@ -18,35 +18,124 @@
 #include <assert.h>
 #include <limits.h>
 #include <time.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <semaphore.h>
 #ifndef M_PI
 #    define M_PI 3.14159265358979323846
 #endif
 
+/*
+ * Sample precision. The FFT, matrix and LPC kernels (fft.c, gauss.c, lpc.c) exist in a float
+ * (_f) and a double (_d) version. The analysis code (formant_track.c, pitch.c) works in
+ * snd_real_t through the unsuffixed names below: double, or float when compiled with
+ * -DTTY_SND_FLOAT (make PRECISION=float). The stream tools name the _f versions, the samples on
+ * the wire being floats either way.
+ */
+#ifdef TTY_SND_FLOAT
+typedef float snd_real_t;
+#define SND_REAL_NS(name) name##_f
+#else
+typedef double snd_real_t;
+#define SND_REAL_NS(name) name##_d
+#endif
+
 
 
 
 /* gauss.c */
 
 
-typedef struct matrix_t {
+typedef struct matrix_f_t {
     int width, height;
     float* data;
-} matrix_t;
-
-matrix_t create_matrix(int width, int height);
-void destroy_matrix(matrix_t mat);
-matrix_t copy_matrix(matrix_t mat);
-matrix_t gaussian(matrix_t mat_input, matrix_t v);
-
-void print_matrix(matrix_t mat);
-
-float get(matrix_t mat, int col, int row);
-void set(matrix_t mat, int col, int row, float val);
-matrix_t invert_matrix(matrix_t mat_input);
-matrix_t matrix_multiply(matrix_t a, matrix_t b);
+} matrix_f_t;
+typedef struct matrix_d_t {
+    int width, height;
+    double* data;
+} matrix_d_t;
+
+/* column-major: element (col, row) is data[col*height + row] */
+static inline float get_f(matrix_f_t mat, int col, int row) { return mat.data[col*mat.height + row]; }
+static inline void set_f(matrix_f_t mat, int col, int row, float val) { mat.data[col*mat.height + row] = val; }
+static inline double get_d(matrix_d_t mat, int col, int row) { return mat.data[col*mat.height + row]; }
+static inline void set_d(matrix_d_t mat, int col, int row, double val) { mat.data[col*mat.height + row] = val; }
+
+/* PA = LU of a square matrix: L (unit diagonal, below) and U share lu, row k was swapped with pivots[k] */
+typedef struct lu_f_t {
+    matrix_f_t lu;
+    int* pivots;
+    bool singular;
+} lu_f_t;
+typedef struct lu_d_t {
+    matrix_d_t lu;
+    int* pivots;
+    bool singular;
+} lu_d_t;
+
+matrix_f_t create_matrix_f(int width, int height);
+void destroy_matrix_f(matrix_f_t mat);
+matrix_f_t copy_matrix_f(matrix_f_t mat);
+matrix_f_t gaussian_f(matrix_f_t mat_input, matrix_f_t v);
+void print_matrix_f(matrix_f_t mat);
+matrix_f_t invert_matrix_f(matrix_f_t mat_input);
+matrix_f_t matrix_multiply_f(matrix_f_t a, matrix_f_t b);
+lu_f_t lu_decompose_f(matrix_f_t mat_input);
+void destroy_lu_f(lu_f_t lu);
+void lu_solve_f(lu_f_t lu, matrix_f_t rhs);
+bool cholesky_decompose_f(matrix_f_t mat);
+void cholesky_solve_f(matrix_f_t chol, matrix_f_t rhs);
+
+matrix_d_t create_matrix_d(int width, int height);
+void destroy_matrix_d(matrix_d_t mat);
+matrix_d_t copy_matrix_d(matrix_d_t mat);
+matrix_d_t gaussian_d(matrix_d_t mat_input, matrix_d_t v);
+void print_matrix_d(matrix_d_t mat);
+matrix_d_t invert_matrix_d(matrix_d_t mat_input);
+matrix_d_t matrix_multiply_d(matrix_d_t a, matrix_d_t b);
+lu_d_t lu_decompose_d(matrix_d_t mat_input);
+void destroy_lu_d(lu_d_t lu);
+void lu_solve_d(lu_d_t lu, matrix_d_t rhs);
+bool cholesky_decompose_d(matrix_d_t mat);
+void cholesky_solve_d(matrix_d_t chol, matrix_d_t rhs);
+
+#ifdef TTY_SND_FLOAT
+typedef matrix_f_t matrix_t;
+typedef lu_f_t lu_t;
+#else
+typedef matrix_d_t matrix_t;
+typedef lu_d_t lu_t;
+#endif
+static inline snd_real_t get(matrix_t mat, int col, int row) { return SND_REAL_NS(get)(mat, col, row); }
+static inline void set(matrix_t mat, int col, int row, snd_real_t val) { SND_REAL_NS(set)(mat, col, row, val); }
+#define create_matrix       SND_REAL_NS(create_matrix)
+#define destroy_matrix      SND_REAL_NS(destroy_matrix)
+#define copy_matrix         SND_REAL_NS(copy_matrix)
+#define gaussian            SND_REAL_NS(gaussian)
+#define print_matrix        SND_REAL_NS(print_matrix)
+#define invert_matrix       SND_REAL_NS(invert_matrix)
+#define matrix_multiply     SND_REAL_NS(matrix_multiply)
+#define lu_decompose        SND_REAL_NS(lu_decompose)
+#define destroy_lu          SND_REAL_NS(destroy_lu)
+#define lu_solve            SND_REAL_NS(lu_solve)
+#define cholesky_decompose  SND_REAL_NS(cholesky_decompose)
+#define cholesky_solve      SND_REAL_NS(cholesky_solve)
 
 
 /* bmp.c */
+typedef struct bitmap_stream_t {
+    FILE* fp;
+    int width;
+    int height;                 /* the rows written so far */
+    int bytes_per_pixel;        /* 3, or 4 with alpha */
+    size_t row_size;            /* bytes, padded to four */
+    float DPI;
+} bitmap_stream_t;
+
+size_t bitmap_row_size(int width, bool has_alpha);
+void open_bitmap_stream(bitmap_stream_t* bmp, const char* file_name, int width, bool has_alpha, float DPI);
+void write_bitmap_rows(bitmap_stream_t* bmp, const uint8_t* rows, int nr_rows);
+void close_bitmap_stream(bitmap_stream_t* bmp);
 void write_bitmap_data(char* file_name, uint8_t* red_data, uint8_t* green_data, uint8_t* blue_data, uint8_t* alpha_data, size_t len, int width, int height, float DPI);
 
 
@@ -71,8 +160,26 @@ float duration(waveform_t form);
 
 /* lpc.c */
 
-float lpc_pole_function(matrix_t lpc_vector, float x);
-matrix_t lpc_float(double* data, size_t len, int nr_formants);
+size_t lpc_rosa_work_size(size_t len, int order);
+size_t lpc_envelope_work_size(size_t nr_bins);
+
+void lpc_coefficients_rosa_into_f(const float* data, size_t len, int order, float* ar_coeffs_out, float* work);
+float* lpc_coefficients_rosa_f(const float* data, size_t len, int order);
+float levinson_durbin_f(const float* r, int order, float* a, float* reflection_out);
+float lpc_pole_function_f(matrix_f_t lpc_vector, float x);
+size_t lpc_envelope_formants_f(const float* coeffs, int order, double frequency, size_t nr_bins, float* formants_out, float* bws_out, size_t max_formants, float* work);
+
+void lpc_coefficients_rosa_into_d(const double* data, size_t len, int order, double* ar_coeffs_out, double* work);
+double* lpc_coefficients_rosa_d(const double* data, size_t len, int order);
+double levinson_durbin_d(const double* r, int order, double* a, double* reflection_out);
+double lpc_pole_function_d(matrix_d_t lpc_vector, double x);
+size_t lpc_envelope_formants_d(const double* coeffs, int order, double frequency, size_t nr_bins, double* formants_out, double* bws_out, size_t max_formants, double* work);
+
+#define lpc_coefficients_rosa_into  SND_REAL_NS(lpc_coefficients_rosa_into)
+#define lpc_coefficients_rosa       SND_REAL_NS(lpc_coefficients_rosa)
+#define levinson_durbin             SND_REAL_NS(levinson_durbin)
+#define lpc_pole_function           SND_REAL_NS(lpc_pole_function)
+#define lpc_envelope_formants       SND_REAL_NS(lpc_envelope_formants)
 
 /* formant.c */
 
@@ -90,14 +197,31 @@ int find_formants(waveform_t form, int nr_formants, matrix_t* formant_values, ma
 
 
 /* root.c */
+typedef enum poly_solve_status_t {
+    POLY_SOLVE_OK = 0,
+    POLY_SOLVE_BAD_DEGREE = 1,
+    POLY_SOLVE_ZERO_LEADING_TERM = 2,
+    POLY_SOLVE_NO_CONVERGENCE = 3,
+} poly_solve_status_t;
 void poly_complex_solve(const double *polynomial_coefficients, size_t nr_of_terms, double* polynomial_roots, double* working_matrix);
+poly_solve_status_t poly_complex_solve_status(const double *polynomial_coefficients, size_t nr_of_terms, double* polynomial_roots, double* working_matrix);
+size_t poly_complex_solve_batch_work_size(size_t nr_of_terms, int nr_threads);
+size_t poly_complex_solve_batch(const double* coefficients, size_t nr_polys, size_t nr_of_terms, double* roots, poly_solve_status_t* status, double* work, int nr_threads);
 
 /* fft.c */
 /* returns a pointer to be freed with free() (i.e. gives ownership)
    the array is made up of complex numbers as in pairs, with real first and then imaginary
    this means that the full frequency part is the sum of squares of both */
-float* fft_power_of_two(float* data, size_t len);
-float* ifft_power_of_two(float* data, size_t len);
+float* fft_power_of_two_f(const float* data, size_t len);
+float* ifft_power_of_two_f(const float* data, size_t len);
+double* fft_power_of_two_d(const double* data, size_t len);
+double* ifft_power_of_two_d(const double* data, size_t len);
+size_t fft_batch_work_size(size_t len);
+void fft_power_of_two_batch_f(const float* data, float* dest, size_t len, size_t nr_transforms, bool inverse, float* work);
+void fft_power_of_two_batch_d(const double* data, double* dest, size_t len, size_t nr_transforms, bool inverse, double* work);
+#define fft_power_of_two        SND_REAL_NS(fft_power_of_two)
+#define ifft_power_of_two       SND_REAL_NS(ifft_power_of_two)
+#define fft_power_of_two_batch  SND_REAL_NS(fft_power_of_two_batch)
 
 
 
@@ -110,7 +234,16 @@ typedef struct interval_t {
 } interval_t;
 
 
+/* growable output buffer for repeated threshold scans; zero-initialize before first use */
+typedef struct interval_buffer_t {
+    interval_t* intervals;
+    size_t nr_intervals;
+    size_t capacity;
+} interval_buffer_t;
+
 void find_intervals_above_cutoff(float* data, size_t len, float cutoff, interval_t** intervals_out, size_t* nr_intervals_out);
+void find_intervals_above_cutoff_into(const float* data, size_t len, float cutoff, interval_buffer_t* buffer);
+void destroy_interval_buffer(interval_buffer_t* buffer);
 
 void print_intervals(interval_t* intervals, size_t nr_intervals);
 
@@ -129,6 +262,11 @@ void write_float_array(float* data, size_t len, const char* filename);
 void quick_sort_float(float* array, size_t len);
 size_t filesize(const char* path);
 void die(const char* str);
+double monotonic_seconds(void);
+void log_column_bins(size_t* column_bins, int columns, double min_hz, double max_hz, double bin_hz, size_t nr_bins);
+size_t column_bin_end(const size_t* column_bins, int c);
+void format_frequency(char* out, size_t size, double hz);
+void heat_color(double x, uint8_t* r, uint8_t* g, uint8_t* b);
 bool is_power_of_2(uint32_t x);
 uint32_t truncate_power_of_2(uint32_t x);
 float clamp(float val, float min, float max);
@@ -162,6 +300,56 @@ typedef struct peak_t {
 } peak_t;
 void debug_peaks(peak_t* peaks, size_t nr_peaks);
 
+
+/* peak_families.c */
+
+typedef struct peak_family_t {
+    float freq;                 /* lowest peak of the family */
+    double octave_nr;
+    double pitch_class_cents;   /* position within the octave, [0,1200) */
+    float max_height;
+    int lowest_formant;
+    int nr_harmonics;
+} peak_family_t;
+
+/* families_out needs space for nr_peaks entries; returns the number of families found */
+size_t group_peak_families(const peak_t* peaks, size_t nr_peaks, float min_height, double tolerance_cents, peak_family_t* families_out, double* vtl_out);
+void write_peak_families(FILE* fp, const peak_family_t* families, size_t nr_families, double vtl);
+
+
+/* rolloff.c */
+
+/* segment tree of argmin/argmax indices over a float array; create once for the largest
+   array and rebuild for every spectrum/frame */
+typedef struct range_query_t {
+    const float* data;
+    size_t len;
+    size_t size;
+    uint32_t* min_tree;
+    uint32_t* max_tree;
+} range_query_t;
+
+range_query_t create_range_query(size_t max_len);
+void build_range_query(range_query_t* rq, const float* data, size_t len);
+void destroy_range_query(range_query_t* rq);
+size_t range_argmin(const range_query_t* rq, size_t lo, size_t hi);
+size_t range_argmax(const range_query_t* rq, size_t lo, size_t hi);
+bool range_last_above(const range_query_t* rq, size_t lo, size_t hi, float value, size_t* out_index);
+void compute_rolloff_velocities(const range_query_t* rq, peak_t* peaks, size_t nr_peaks);
+
+
+/* spectrum_peaks.c */
+
+typedef struct peak_finder_t {
+    size_t max_len;    /* in complex values */
+    float* magnitudes; /* normalized magnitude spectrum */
+    range_query_t rq;
+} peak_finder_t;
+
+peak_finder_t create_peak_finder(size_t max_len);
+void destroy_peak_finder(peak_finder_t* finder);
+size_t find_spectrum_peaks(peak_finder_t* finder, const float* spectrum, size_t len, float frequency, float cutoff_step, int min_cents_difference, peak_t** peaks_out);
+
 char** split(const char* str, size_t len, char sep, int* out_num_strings);
 float *transform_float_to_complex_array(const float* old_array, size_t length);
 
@@ -173,8 +361,32 @@ typedef struct formant_t {
 
 
 /* direct_peak.c */
-int* calculate_peaks(float* data, size_t len, const char* filename);
-int* calculate_peaks_dbl(double* data, size_t len, const char* filename);
+
+/* what a local maximum has to meet to be a peak; min_height -INFINITY, and min_prominence and
+   min_distance 0, leave a constraint out */
+typedef struct peak_constraints_t {
+    double min_height;
+    double min_prominence;  /* above the higher of the minima down to the next higher sample on either side */
+    size_t min_distance;    /* in samples; of two peaks closer than that only the higher one is kept */
+} peak_constraints_t;
+
+typedef struct peak_rank_t {
+    double height;
+    size_t nr;
+} peak_rank_t;
+
+/* growable output buffer of calculate_peaks; zero-initialize before first use */
+typedef struct peak_index_buffer_t {
+    size_t* indices;        /* ascending */
+    size_t nr_indices;
+    size_t capacity;
+    peak_rank_t* ranks;     /* scratch for min_distance */
+    bool* removed;
+} peak_index_buffer_t;
+
+size_t calculate_peaks(const float* data, size_t len, const peak_constraints_t* constraints, peak_index_buffer_t* buffer);
+size_t calculate_peaks_dbl(const double* data, size_t len, const peak_constraints_t* constraints, peak_index_buffer_t* buffer);
+void destroy_peak_buffer(peak_index_buffer_t* buffer);
 
 
 
@@ -194,6 +406,22 @@ void sleep_us(uint32_t us);
 
 
 
+/* minmax_pyramid.c */
+
+typedef struct minmax_pyramid_t {
+    size_t len;                 /* of the data, level 0 */
+    int nr_levels;
+    size_t* level_len;
+    float** min;                /* entry i of level l covers the samples [i*2^l, (i+1)*2^l) */
+    float** max;
+} minmax_pyramid_t;
+
+void create_minmax_pyramid(minmax_pyramid_t* pyramid, const float* data, size_t len);
+void destroy_minmax_pyramid(minmax_pyramid_t* pyramid);
+int minmax_pyramid_columns(const minmax_pyramid_t* pyramid, double first, double last, size_t nr_columns, float* col_min, float* col_max);
+
+
+
 /* simple_wav.c */
 
 typedef struct simple_wav_t {
@@ -204,6 +432,10 @@ typedef struct simple_wav_t {
     peak_t* peaks;
 } simple_wav_t;
 simple_wav_t read_simple_wav(FILE* fp);
+bool try_read_simple_wav(FILE* fp, simple_wav_t* wav_out);
+bool read_simple_wav_header(FILE* fp, simple_wav_t* header_out);
+void read_simple_wav_samples(FILE* fp, float* samples, size_t nr);
+size_t read_stream_real_parts(FILE* fp, size_t* remaining, float* frequency_in_hz, float* out, size_t max_frames);
 void write_simple_wav(FILE* fp, simple_wav_t data);
 
 
@@ -216,30 +448,231 @@ void convert_to_extended_float_be(double val, char* outptr);
 double convert_from_extended_float_be(char* inptr);
 
 
-/* lpc.c */
-float* lpc_coefficients_rosa(float* data, size_t len, int order);
-double* lpc_coefficients_rosa_double(double* data, size_t len, int order);
-
-/* marple_alg_2.c */
-int ar_params (double *x_in /* data */,
-     int n /* num_values */,
-     int mmax /* nr_formants */,
-     float tol1, float tol2 /* tolerances */,
-     int* out_m /* out_calculated */,
-     double *a_in /* out_ar_params, has to have nr_formants space */,
-     float *out_e /* out_pred_error_energy_order_m */,
-     float *out_e0 /* out_twice_total_energy */
-     );
+
+/* marple-alg_2.c */
+
+typedef enum ar_status_t {
+    AR_SUCCESS = 0,             /* reached the requested order */
+    AR_DEN_ILL_CONDITIONED = 1, /* the time update broke down, a holds the order before */
+    AR_A_ILL_CONDITIONED = 2,   /* reflection coefficient of magnitude >= 1 */
+    AR_TOL1_REACHED = 3,        /* error energy fell below tol1 times the signal energy */
+    AR_TOL2_REACHED = 4,        /* error energy improved by less than the fraction tol2 */
+} ar_status_t;
+
+size_t ar_params_work_size(int mmax);
+ar_status_t ar_params_into(const double* x, int n, int mmax, double tol1, double tol2, int* out_m, double* a, double* out_e, double* out_e0, double* work);
+ar_status_t ar_params(const double* x, int n, int mmax, double tol1, double tol2, int* out_m, double* a, double* out_e, double* out_e0);
+
 /* informant_algs.c */
 
 double* autocorr_solve(const double *data, int length, int lpcOrder, double *pGain, size_t* out_nr_formants);
 double* Covar_solve(const double *data, int length, int lpcOrder, double *pGain, size_t* out_nr_formants);
 double* Burg_solve(const double *x, int length, int lpcOrder, double *pGain, size_t* out_nr_formants);
 
+size_t autocorr_work_size(int lpcOrder);
+size_t covar_work_size(int lpcOrder);
+size_t burg_work_size(int lpcOrder, int length);
+int autocorr_solve_into(const double *data, int length, int lpcOrder, double *lpc_out, double *pGain, double *work);
+int Covar_solve_into(const double *data, int length, int lpcOrder, double *lpc_out, double *pGain, double *work);
+int Burg_solve_into(const double *x, int length, int lpcOrder, double *lpc_out, double *pGain, double *work);
+
+
+/* lpc_engine.c */
+
+typedef enum lpc_method_t {
+    LPC_AUTOCORRELATION = 0,
+    LPC_COVARIANCE = 1,
+    LPC_BURG = 2,
+    LPC_MARPLE = 3,
+    LPC_ROSA = 4,
+} lpc_method_t;
+
+typedef struct lpc_engine_t {
+    lpc_method_t method;
+    int max_order;
+    size_t max_length;
+    double* coeffs;         /* A(z) = 1 + coeffs[1] z^-1 + ... + coeffs[order] z^-order, coeffs[0] = 1 */
+    int order;              /* order reached by the last analysis */
+    double gain;            /* prediction error energy of the last analysis */
+    int status;             /* 0, or the failure code of the method (ar_params status for Marple) */
+    float marple_tol1, marple_tol2;
+    double* work;
+    size_t work_size;
+} lpc_engine_t;
+
+lpc_engine_t create_lpc_engine(lpc_method_t method, int max_order, size_t max_length);
+void destroy_lpc_engine(lpc_engine_t* engine);
+const char* lpc_method_name(lpc_method_t method);
+bool lpc_method_from_name(const char* name, lpc_method_t* method_out);
+int lpc_engine_analyze(lpc_engine_t* engine, const double* data, size_t len, int order);
+void lpc_engine_root_polynomial(const lpc_engine_t* engine, double* ascending_out);
+
+
+/* threads.c */
+
+#define MAX_THREADS 64
+
+typedef void (*parallel_job_t)(void* ctx, int thread_nr, size_t job_nr);
+int default_thread_count(void);
+void parallel_for(size_t nr_jobs, int nr_threads, parallel_job_t job, void* ctx);
+
+
+/* formant_track.c */
+
+typedef struct formant_track_params_t {
+    double window_length;    /* nominal length in seconds, the Gaussian window is twice as long */
+    double time_step;        /* in seconds */
+    double max_formant;      /* in Hz, the sound is resampled to twice this */
+    int nr_formants;
+    double preemphasis_from; /* in Hz */
+    int nr_threads;
+    bool warm_start;         /* start each frame's root search from the previous frame's roots */
+    bool fast;               /* peaks of the LPC envelope instead of the roots of the predictor */
+} formant_track_params_t;
+
+typedef struct formant_track_t {
+    size_t nr_frames;
+    int nr_formants;
+    double time_step, first_time; /* in seconds */
+    double* freqs;                /* nr_frames x nr_formants, NAN where a formant is missing */
+    double* bws;
+} formant_track_t;
+
+/* per-thread analysis state, kept across sounds by callers that analyse many of them */
+typedef struct formant_track_workspace_t {
+    int nr_threads;
+    size_t frame_len;
+    unsigned long order;
+    struct formants_work_t** works; /* libformants' work_t */
+    snd_real_t** frames;
+    snd_real_t** scratch;
+    struct libf_formant_t** formants; /* the formants of a frame, order/2 of them */
+} formant_track_workspace_t;
+
+void init_formant_track_params(formant_track_params_t* params);
+formant_track_workspace_t create_formant_track_workspace(int nr_threads);
+void destroy_formant_track_workspace(formant_track_workspace_t* workspace);
+formant_track_t track_formants(const float* samples, size_t stride, size_t len, double sample_rate, const formant_track_params_t* params);
+formant_track_t track_formants_with(formant_track_workspace_t* workspace, const float* samples, size_t stride, size_t len, double sample_rate, const formant_track_params_t* params);
+void destroy_formant_track(formant_track_t* track);
+void formant_track_means(const formant_track_t* track, double* mean_freqs, double* mean_bws);
+void write_formant_track(FILE* fp, const formant_track_t* track);
+void write_formant_means(FILE* fp, const formant_track_t* track, const char* prefix);
+
+/* pitch.c */
+
+typedef struct pitch_params_t {
+    double min_f0, max_f0; /* in Hz, the lag range searched */
+    double time_step;      /* in seconds */
+    double threshold;      /* YIN's absolute threshold on the normalized difference */
+    int nr_threads;
+} pitch_params_t;
+
+typedef struct pitch_track_t {
+    size_t nr_frames;
+    double time_step, first_time; /* in seconds */
+    double* f0;                   /* NAN where the frame is unvoiced */
+    double* strength;             /* 1 - d'(period), 0 for silence */
+} pitch_track_t;
+
+typedef struct pitch_workspace_t {
+    int nr_threads;
+    size_t buffer_size;
+    snd_real_t** buffers; /* one per thread */
+} pitch_workspace_t;
+
+void init_pitch_params(pitch_params_t* params);
+pitch_workspace_t create_pitch_workspace(int nr_threads);
+void destroy_pitch_workspace(pitch_workspace_t* workspace);
+pitch_track_t track_pitch(const float* samples, size_t stride, size_t len, double sample_rate, const pitch_params_t* params);
+pitch_track_t track_pitch_with(pitch_workspace_t* workspace, const float* samples, size_t stride, size_t len, double sample_rate, const pitch_params_t* params);
+void destroy_pitch_track(pitch_track_t* track);
+double pitch_track_mean(const pitch_track_t* track);
+void write_pitch_track(FILE* fp, const pitch_track_t* track);
+
+
+
+
+/* capture.c */
+
+/* lock-free ring of fixed size frames between one producer and one consumer thread */
+typedef struct frame_ring_t {
+    uint8_t* data;
+    size_t frame_size;          /* bytes */
+    size_t capacity;            /* frames, a power of two */
+    atomic_size_t write_pos;    /* frames written and read so far */
+    atomic_size_t read_pos;
+} frame_ring_t;
+
+void init_frame_ring(frame_ring_t* ring, size_t frame_size, size_t min_frames);
+void destroy_frame_ring(frame_ring_t* ring);
+size_t frame_ring_write(frame_ring_t* ring, const void* frames, size_t nr_frames);
+size_t frame_ring_read(frame_ring_t* ring, void* frames, size_t max_frames);
+size_t frame_ring_available(frame_ring_t* ring);
+
+typedef struct sample_format_t {
+    int channels;               /* 1 or 2, interleaved */
+    bool is_float;              /* 32 bit float (AL_EXT_FLOAT32) instead of 16 bit integer */
+} sample_format_t;
+
+ALenum al_sample_format(sample_format_t format);
+size_t sample_frame_size(sample_format_t format);
+void frames_to_mono(const void* frames, size_t nr_frames, sample_format_t format, float* out, size_t stride);
+
+/* loopback.c */
+
+typedef struct loopback_t {
+    ALCdevice* device;
+    ALCcontext* context;
+    int rate;
+    sample_format_t format;     /* of the rendered mix */
+    ALuint source, buffer;      /* of loopback_play_stream, 0 before */
+} loopback_t;
+
+bool open_loopback(loopback_t* loopback, int rate, sample_format_t format);
+void close_loopback(loopback_t* loopback);
+void loopback_render(loopback_t* loopback, void* frames, size_t nr_frames);
+void loopback_play_stream(loopback_t* loopback, const simple_wav_t* wav);
+bool loopback_playing(loopback_t* loopback);
+
+/* a source the capture thread renders itself a period at a time, instead of draining a device:
+   a loopback device, or the synthetic impulses of tty-snd-latency */
+typedef struct render_source_t {
+    void (*render)(void* arg, void* frames, size_t nr_frames);
+    bool (*playing)(void* arg);     /* false once the source has played out */
+    void* arg;
+    int rate;
+    sample_format_t format;
+} render_source_t;
+
+typedef struct capture_t {
+    ALCdevice* device;          /* NULL for a rendered source */
+    render_source_t source;
+    bool realtime;              /* a rendered source is paced like a device */
+    double start_time;          /* monotonic_seconds when the capture started */
+    size_t frame_size;          /* bytes, as the device delivers them */
+    double sample_rate;
+    size_t period_frames;
+    void* period_buffer;
+    frame_ring_t ring;
+    sem_t readable;             /* posted by the capture thread after every period */
+    atomic_bool running;
+    atomic_size_t dropped_frames;
+    pthread_t thread;
+} capture_t;
+
+ALCdevice* open_capture_device(int dev_nr, int rate, sample_format_t* format, size_t buffer_frames);
+void start_capture(capture_t* capture, ALCdevice* device, size_t frame_size, double sample_rate, double period, double ring_time);
+void start_rendered_capture(capture_t* capture, const render_source_t* source, double period, double ring_time, bool realtime);
+void start_loopback_capture(capture_t* capture, loopback_t* loopback, double period, double ring_time, bool realtime);
+size_t capture_read(capture_t* capture, void* frames, size_t max_frames);
+void stop_capture(capture_t* capture);
 
 
 
 /* r_formant_code */
-void r_find_formants(double* sound, size_t len, double frequency, int order, int maxbw, int minformant, double* formants, double* bws, bool* is_selected);
+int r_default_order(double frequency);
+void r_find_formants(lpc_engine_t* engine, const float* samples, size_t stride, size_t len, double frequency, int order, int maxbw, int minformant, double* formants, double* bws, bool* is_selected);
+void r_find_formants_fft(lpc_engine_t* engine, const float* samples, size_t stride, size_t len, double frequency, int order, int maxbw, int minformant, double* formants, double* bws, bool* is_selected);
 
 #endif
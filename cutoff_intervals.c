@@ -1,45 +1,101 @@
 #include "common.h"
 
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#define CUTOFF_USE_SSE2
+#endif
 
 
 
+void destroy_interval_buffer(interval_buffer_t* buffer) {
+    free(buffer[0].intervals);
+    buffer[0].intervals = NULL;
+    buffer[0].nr_intervals = 0;
+    buffer[0].capacity = 0;
+}
 
+static void push_interval(interval_buffer_t* buffer, size_t lower_index, size_t upper_index) {
+    if(buffer[0].nr_intervals == buffer[0].capacity) {
+        size_t new_capacity = (buffer[0].capacity == 0) ? 64 : 2*buffer[0].capacity;
+        interval_t* new_intervals = realloc(buffer[0].intervals, new_capacity*sizeof(interval_t));
+        if(new_intervals == NULL) die("out of memory growing interval buffer!\n");
+        buffer[0].intervals = new_intervals;
+        buffer[0].capacity = new_capacity;
+    }
+    buffer[0].intervals[buffer[0].nr_intervals].lower_index = lower_index;
+    buffer[0].intervals[buffer[0].nr_intervals].upper_index = upper_index;
+    buffer[0].nr_intervals++;
+}
 
-void find_intervals_above_cutoff(float* data, size_t len, float cutoff, interval_t** intervals_out, size_t* nr_intervals_out) {
-    assert(nr_intervals_out != NULL && intervals_out != NULL);
+/*
+ * One pass over the data: an interval starts at the first sample > cutoff and ends at the
+ * next sample < cutoff (samples equal to the cutoff keep the current state). With SSE2 we
+ * compare 16 samples at a time and only look at single lanes when a movemask says that the
+ * state actually changes in this block, so long runs above or below the cutoff are skipped
+ * at memory speed.
+ */
+void find_intervals_above_cutoff_into(const float* data, size_t len, float cutoff, interval_buffer_t* buffer) {
+    assert(buffer != NULL);
+    buffer[0].nr_intervals = 0;
 
-    size_t nr_intervals = 0, intervals_calculated = 0;
     bool is_in_interval = false;
-    for(int i = 0; i < len; i++) {
-        if(!is_in_interval && data[i] > cutoff) {
-            is_in_interval = true;
-            nr_intervals++;
-        } else if (is_in_interval && data[i] < cutoff) {
-            is_in_interval = false;
+    size_t lower_index = 0;
+    size_t i = 0;
+
+#ifdef CUTOFF_USE_SSE2
+    const __m128 cut = _mm_set1_ps(cutoff);
+    for(; i + 16 <= len; i += 16) {
+        __m128 v0 = _mm_loadu_ps(&data[i]);
+        __m128 v1 = _mm_loadu_ps(&data[i+4]);
+        __m128 v2 = _mm_loadu_ps(&data[i+8]);
+        __m128 v3 = _mm_loadu_ps(&data[i+12]);
+        unsigned int above = _mm_movemask_ps(_mm_cmpgt_ps(v0, cut))
+                          | (_mm_movemask_ps(_mm_cmpgt_ps(v1, cut)) << 4)
+                          | (_mm_movemask_ps(_mm_cmpgt_ps(v2, cut)) << 8)
+                          | (_mm_movemask_ps(_mm_cmpgt_ps(v3, cut)) << 12);
+        unsigned int below = _mm_movemask_ps(_mm_cmplt_ps(v0, cut))
+                          | (_mm_movemask_ps(_mm_cmplt_ps(v1, cut)) << 4)
+                          | (_mm_movemask_ps(_mm_cmplt_ps(v2, cut)) << 8)
+                          | (_mm_movemask_ps(_mm_cmplt_ps(v3, cut)) << 12);
+
+        unsigned int crossings = is_in_interval ? below : above;
+        while(crossings != 0) {
+            int lane = __builtin_ctz(crossings);
+            if(is_in_interval) {
+                push_interval(buffer, lower_index, i+lane);
+            } else {
+                lower_index = i+lane;
+            }
+            is_in_interval = !is_in_interval;
+            /* only lanes after the crossing can flip the new state back */
+            unsigned int later_lanes = ~((2u << lane) - 1u);
+            crossings = (is_in_interval ? below : above) & later_lanes;
         }
     }
+#endif
 
-    nr_intervals_out[0] = nr_intervals;
-    intervals_out[0] = calloc(sizeof(interval_t), nr_intervals);
-
-    is_in_interval = false;
-    for(int i = 0; i < len; i++) {
+    for(; i < len; i++) {
         if(!is_in_interval && data[i] > cutoff) {
             is_in_interval = true;
-            intervals_out[0][intervals_calculated].lower_index = i;
+            lower_index = i;
         } else if (is_in_interval && data[i] < cutoff) {
             is_in_interval = false;
-            intervals_out[0][intervals_calculated].upper_index = i;
-            intervals_calculated++;
+            push_interval(buffer, lower_index, i);
         }
     }
     if(is_in_interval) {
-        is_in_interval = false;
-        intervals_out[0][intervals_calculated].upper_index = len-1;
-        intervals_calculated++;
+        push_interval(buffer, lower_index, len-1);
     }
+}
+
+void find_intervals_above_cutoff(float* data, size_t len, float cutoff, interval_t** intervals_out, size_t* nr_intervals_out) {
+    assert(nr_intervals_out != NULL && intervals_out != NULL);
+
+    interval_buffer_t buffer = {0};
+    find_intervals_above_cutoff_into(data, len, cutoff, &buffer);
 
-    assert(intervals_calculated == nr_intervals);
+    nr_intervals_out[0] = buffer.nr_intervals;
+    intervals_out[0] = buffer.intervals;
 }
 
 
@@ -107,6 +163,7 @@ void chunk_interval_list(interval_t* intervals, size_t nr_intervals, interval_t*
         }
         if(!sth_still_to_do) break;
     }
+    free(pos_marker);
 
     nr_intervals_out[0] = 0;
     for(int i = 0; i < nr_intervals; i++) {
@@ -208,8 +265,10 @@ void sort_interval_lists(interval_t* intervals, size_t nr_intervals) {
 void get_sorted_iteratively_merged_interval_list_by_cutoff_step(float* data, size_t len, float cutoff_step, interval_t** intervals_out, size_t* nr_intervals_out) {
     assert(cutoff_step < 1.0f && cutoff_step > 0.0f);
 
-    interval_t* base_intervals, *iteration_intervals, *merge_intervals, *chunk_intervals;
-    size_t nr_base, nr_it, nr_merge, nr_chunk;
+    interval_t* base_intervals, *merge_intervals, *chunk_intervals;
+    size_t nr_base, nr_merge, nr_chunk;
+    /* reused for every cutoff, so the scans don't allocate once the buffer has grown */
+    interval_buffer_t iteration_buffer = {0};
 
     find_intervals_above_cutoff(data, len, 1.0f, &base_intervals, &nr_base);
     /*printf("Base: \n");
@@ -220,12 +279,12 @@ void get_sorted_iteratively_merged_interval_list_by_cutoff_step(float* data, siz
         float cutoff = fmaxf(1.0f-cutoff_step*i, 0.0f);
 
         /*printf("Iteration %i: \n", i); */
-        find_intervals_above_cutoff(data, len, cutoff, &iteration_intervals, &nr_it);
-        /*print_intervals(iteration_intervals, nr_it);*/
+        find_intervals_above_cutoff_into(data, len, cutoff, &iteration_buffer);
+        /*print_intervals(iteration_buffer.intervals, iteration_buffer.nr_intervals);*/
 
 
         /*printf("tmp Chunk %i: \n", i);*/
-        chunk_interval_list(iteration_intervals, nr_it, &chunk_intervals, &nr_chunk, 5);
+        chunk_interval_list(iteration_buffer.intervals, iteration_buffer.nr_intervals, &chunk_intervals, &nr_chunk, 5);
         /*print_intervals(chunk_intervals, nr_chunk);*/
 
         /*printf("Merge %i: \n", i);*/
@@ -241,11 +300,11 @@ void get_sorted_iteratively_merged_interval_list_by_cutoff_step(float* data, siz
 
         free(chunk_intervals);
         free(base_intervals);
-        free(iteration_intervals);
 
         base_intervals = merge_intervals;
         nr_base = nr_merge;
     }
+    destroy_interval_buffer(&iteration_buffer);
 
     if(nr_intervals_out != NULL)
         nr_intervals_out[0] = nr_base;
@@ -0,0 +1,119 @@
+#include "common.h"
+
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#define DIRECT_PEAK_USE_SSE2
+#endif
+
+/*
+ * Direct peak picking: the local maxima of a spectrum, without the thresholds and intervals of
+ * spectrum_peaks.c. A sample is a peak if it is higher than the one before it and not lower than
+ * the one after it (so a plateau counts once, at its left edge) and at least min_height. Then,
+ * as scipy's find_peaks does it, peaks closer than min_distance to a higher one are dropped, and
+ * what is left has to stand out by min_prominence.
+ *
+ * The local maximum test is most of the work and runs over whole vectors: the sample, its left
+ * and its right neighbour are compared lane by lane, and a movemask of the three compares gives
+ * the peaks of the block, so blocks without one cost three loads and a few compares.
+ */
+
+static void reserve_peak_buffer(peak_index_buffer_t* buffer, size_t capacity) {
+    if(capacity <= buffer[0].capacity) return;
+    size_t new_capacity = (buffer[0].capacity == 0) ? 64 : buffer[0].capacity;
+    while(new_capacity < capacity) new_capacity *= 2;
+    buffer[0].indices = realloc(buffer[0].indices, new_capacity*sizeof(size_t));
+    buffer[0].ranks = realloc(buffer[0].ranks, new_capacity*sizeof(peak_rank_t));
+    buffer[0].removed = realloc(buffer[0].removed, new_capacity*sizeof(bool));
+    if(buffer[0].indices == NULL || buffer[0].ranks == NULL || buffer[0].removed == NULL) die("out of memory growing peak buffer!\n");
+    buffer[0].capacity = new_capacity;
+}
+
+void destroy_peak_buffer(peak_index_buffer_t* buffer) {
+    free(buffer[0].indices);
+    free(buffer[0].ranks);
+    free(buffer[0].removed);
+    memset(buffer, 0, sizeof(peak_index_buffer_t));
+}
+
+static int compare_peak_ranks(const void* a, const void* b) {
+    const peak_rank_t* x = a;
+    const peak_rank_t* y = b;
+    if(x[0].height != y[0].height) return (x[0].height < y[0].height) ? 1 : -1;
+    return (x[0].nr < y[0].nr) ? -1 : (x[0].nr > y[0].nr) ? 1 : 0;
+}
+
+/* drops the peaks closer than min_distance to a higher one that is kept, the higher first; the
+   ranks hold the heights of the peaks */
+static void enforce_peak_distance(peak_index_buffer_t* buffer, size_t min_distance) {
+    size_t nr = buffer[0].nr_indices;
+    size_t* indices = buffer[0].indices;
+    bool* removed = buffer[0].removed;
+    if(min_distance < 2 || nr < 2) return;
+
+    for(size_t p = 0; p < nr; p++) {
+        buffer[0].ranks[p].nr = p;
+        removed[p] = false;
+    }
+    qsort(buffer[0].ranks, nr, sizeof(peak_rank_t), compare_peak_ranks);
+    for(size_t r = 0; r < nr; r++) {
+        size_t p = buffer[0].ranks[r].nr;
+        if(removed[p]) continue;
+        for(size_t q = p; q > 0 && indices[p] - indices[q-1] < min_distance; q--) removed[q-1] = true;
+        for(size_t q = p+1; q < nr && indices[q] - indices[p] < min_distance; q++) removed[q] = true;
+    }
+
+    size_t kept = 0;
+    for(size_t p = 0; p < nr; p++) {
+        if(!removed[p]) indices[kept++] = indices[p];
+    }
+    buffer[0].nr_indices = kept;
+}
+
+/* the float and double versions, see snd_real_t in common.h */
+#define REAL float
+#define RNS(name) name
+#ifdef DIRECT_PEAK_USE_SSE2
+#define VEC __m128
+#define VEC_WIDTH 4
+#define VEC_SET1 _mm_set1_ps
+#define VEC_LOADU _mm_loadu_ps
+#define VEC_AND _mm_and_ps
+#define VEC_CMPGT _mm_cmpgt_ps
+#define VEC_CMPGE _mm_cmpge_ps
+#define VEC_MOVEMASK _mm_movemask_ps
+#endif
+#include "direct_peak_template.h"
+#undef REAL
+#undef RNS
+#undef VEC
+#undef VEC_WIDTH
+#undef VEC_SET1
+#undef VEC_LOADU
+#undef VEC_AND
+#undef VEC_CMPGT
+#undef VEC_CMPGE
+#undef VEC_MOVEMASK
+
+#define REAL double
+#define RNS(name) name##_dbl
+#ifdef DIRECT_PEAK_USE_SSE2
+#define VEC __m128d
+#define VEC_WIDTH 2
+#define VEC_SET1 _mm_set1_pd
+#define VEC_LOADU _mm_loadu_pd
+#define VEC_AND _mm_and_pd
+#define VEC_CMPGT _mm_cmpgt_pd
+#define VEC_CMPGE _mm_cmpge_pd
+#define VEC_MOVEMASK _mm_movemask_pd
+#endif
+#include "direct_peak_template.h"
+#undef REAL
+#undef RNS
+#undef VEC
+#undef VEC_WIDTH
+#undef VEC_SET1
+#undef VEC_LOADU
+#undef VEC_AND
+#undef VEC_CMPGT
+#undef VEC_CMPGE
+#undef VEC_MOVEMASK
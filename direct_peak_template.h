@@ -0,0 +1,64 @@
+/* direct_peak.c, instantiated once per sample type: REAL is the sample type and RNS(name) the
+   suffixed name; with DIRECT_PEAK_USE_SSE2, VEC is the SSE2 vector of VEC_WIDTH REALs and the
+   VEC_ macros its loads and compares */
+
+/* the local maxima at least height high; every second sample at most is one */
+static size_t RNS(local_maxima)(const REAL* data, size_t len, REAL height, size_t* out) {
+    size_t nr = 0;
+    size_t i = 1;
+
+#ifdef DIRECT_PEAK_USE_SSE2
+    const VEC h = VEC_SET1(height);
+    for(; i + 2*VEC_WIDTH+1 <= len; i += 2*VEC_WIDTH) {
+        VEC c0 = VEC_LOADU(&data[i]);
+        VEC c1 = VEC_LOADU(&data[i+VEC_WIDTH]);
+        VEC m0 = VEC_AND(VEC_AND(VEC_CMPGT(c0, VEC_LOADU(&data[i-1])), VEC_CMPGE(c0, VEC_LOADU(&data[i+1]))), VEC_CMPGE(c0, h));
+        VEC m1 = VEC_AND(VEC_AND(VEC_CMPGT(c1, VEC_LOADU(&data[i+VEC_WIDTH-1])), VEC_CMPGE(c1, VEC_LOADU(&data[i+VEC_WIDTH+1]))), VEC_CMPGE(c1, h));
+        unsigned int mask = VEC_MOVEMASK(m0) | (VEC_MOVEMASK(m1) << VEC_WIDTH);
+        while(mask != 0) {
+            out[nr++] = i + __builtin_ctz(mask);
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    for(; i + 1 < len; i++) {
+        if(data[i] > data[i-1] && data[i] >= data[i+1] && data[i] >= height) out[nr++] = i;
+    }
+    return nr;
+}
+
+/* how far the peak at i rises above the higher of the two lowest points between it and the next
+   higher sample, or the end of the data, on either side */
+static double RNS(peak_prominence)(const REAL* data, size_t len, size_t i) {
+    REAL left = data[i], right = data[i];
+    for(size_t j = i; j > 0 && data[j-1] <= data[i]; j--) if(data[j-1] < left) left = data[j-1];
+    for(size_t j = i+1; j < len && data[j] <= data[i]; j++) if(data[j] < right) right = data[j];
+    return (double) data[i] - ((left > right) ? left : right);
+}
+
+/*
+ * Writes the indices of the peaks of data that meet the constraints to the buffer, ascending,
+ * and returns how many there are. Nothing is allocated once the buffer has grown to the largest
+ * data, so the same buffer can be used for a spectrum per hop.
+ */
+size_t RNS(calculate_peaks)(const REAL* data, size_t len, const peak_constraints_t* constraints, peak_index_buffer_t* buffer) {
+    assert(buffer != NULL && constraints != NULL);
+    buffer[0].nr_indices = 0;
+    if(len < 3) return 0;
+    reserve_peak_buffer(buffer, len/2);
+
+    buffer[0].nr_indices = RNS(local_maxima)(data, len, (REAL) constraints[0].min_height, buffer[0].indices);
+    if(constraints[0].min_distance > 1) {
+        for(size_t p = 0; p < buffer[0].nr_indices; p++) buffer[0].ranks[p].height = data[buffer[0].indices[p]];
+        enforce_peak_distance(buffer, constraints[0].min_distance);
+    }
+    if(constraints[0].min_prominence > 0.0) {
+        size_t kept = 0;
+        for(size_t p = 0; p < buffer[0].nr_indices; p++) {
+            if(RNS(peak_prominence)(data, len, buffer[0].indices[p]) >= constraints[0].min_prominence) buffer[0].indices[kept++] = buffer[0].indices[p];
+        }
+        buffer[0].nr_indices = kept;
+    }
+    return buffer[0].nr_indices;
+}
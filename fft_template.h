@@ -0,0 +1,87 @@
+/* fft.c, instantiated once per precision: REAL is the sample type, RNS(name) the suffixed name */
+
+/* twiddle factors for all levels at once, in bit-reversed order: level l with inner index i needs
+   the twiddle reverse_bits(i, l) << (N-2-l), which is reverse_bits(i, N-2), so it is entry i */
+static void RNS(fft_make_twiddles)(size_t len, bool reverse, REAL* twiddle_cos, REAL* twiddle_sin) {
+    size_t nr_twiddles = fft_nr_twiddles(len);
+    int width = (len >= 8) ? (int) log2(len) - 2 : 0;
+    for(size_t i = 0; i < nr_twiddles; i++) {
+        size_t k = (width > 0) ? reverse_bits(i, width) : 0;
+        twiddle_cos[i] = cos(2*M_PI*k/(len/2));
+        twiddle_sin[i] = (reverse ? -1.0 : 1.0)*sin(2*M_PI*k/(len/2));
+    }
+}
+
+/* destroys the data array! */
+static void RNS(fft_transform)(REAL* data, REAL* dest, size_t len, bool reverse, const REAL* twiddle_cos, const REAL* twiddle_sin) {
+    if(!is_power_of_2(len) || len == 1) return;
+    int N = log2(len);
+    for(int l = 0; l < N-1; l++) {
+        for(int combined_i = 0; combined_i < len/4; combined_i++) {
+			int bucket = ((1<<((N-2)-l))-1) & combined_i;
+			int inner_index = (combined_i - bucket) >> ((N-2)-l);
+			int even_index = ((combined_i - bucket) << 2) | (bucket << 1);
+			int odd_index = ((combined_i - bucket) << 2) | (1 << (N-l-1)) | (bucket << 1);
+			REAL c = twiddle_cos[inner_index],
+					s = twiddle_sin[inner_index];
+			REAL even_real = data[even_index], even_imag = data[even_index+1];
+			REAL odd_real  = data[odd_index],  odd_imag  = data[odd_index+1];
+			data[even_index]   = even_real + c*odd_real - s*odd_imag;
+			data[even_index+1] = even_imag + s*odd_real + c*odd_imag;
+			data[odd_index]    = even_real - c*odd_real + s*odd_imag;
+			data[odd_index+1]  = even_imag - s*odd_real - c*odd_imag;
+		}
+    }
+    for (int i = 0; i < len/2; i++) {
+        int real_index = reverse_bits(i, N-1);
+        dest[2*i] = data[2*real_index] / (reverse ? (REAL)(1<<(N-1)) : (REAL)1);
+        dest[2*i+1] = data[2*real_index+1] / (reverse ? (REAL)(1<<(N-1)) : (REAL)1);
+    }
+}
+
+/* destroys the data array! */
+static void RNS(fft_power_of_two_inplace)(REAL* data, REAL* dest, size_t len, bool reverse) {
+    size_t nr_twiddles = fft_nr_twiddles(len);
+    REAL* twiddle_cos = malloc(nr_twiddles*sizeof(REAL));
+    REAL* twiddle_sin = malloc(nr_twiddles*sizeof(REAL));
+    RNS(fft_make_twiddles)(len, reverse, twiddle_cos, twiddle_sin);
+    RNS(fft_transform)(data, dest, len, reverse, twiddle_cos, twiddle_sin);
+    free(twiddle_cos);
+    free(twiddle_sin);
+}
+
+
+
+REAL* RNS(fft_power_of_two)(const REAL* data, size_t len) {
+	REAL* copy = malloc(len*sizeof(REAL));
+	memcpy(copy, data, len*sizeof(REAL));
+	REAL* dest = calloc(len, sizeof(REAL));
+	RNS(fft_power_of_two_inplace)(copy, dest, len, false);
+	free(copy);
+	return dest;
+}
+REAL* RNS(ifft_power_of_two)(const REAL* data, size_t len) {
+	REAL* copy = malloc(len*sizeof(REAL));
+	memcpy(copy, data, len*sizeof(REAL));
+	REAL* dest = calloc(len, sizeof(REAL));
+	RNS(fft_power_of_two_inplace)(copy, dest, len, true);
+	free(copy);
+	return dest;
+}
+
+/*
+ * nr_transforms transforms of len values (len/2 complex numbers) each, stored one after the
+ * other; dest may be data. The twiddle factors are computed once for the whole batch and work
+ * (fft_batch_work_size(len) values) is all the scratch space needed, so frame loops don't allocate.
+ */
+void RNS(fft_power_of_two_batch)(const REAL* data, REAL* dest, size_t len, size_t nr_transforms, bool inverse, REAL* work) {
+    size_t nr_twiddles = fft_nr_twiddles(len);
+    REAL* twiddle_cos = work;
+    REAL* twiddle_sin = &work[nr_twiddles];
+    REAL* copy = &work[2*nr_twiddles];
+    RNS(fft_make_twiddles)(len, inverse, twiddle_cos, twiddle_sin);
+    for(size_t t = 0; t < nr_transforms; t++) {
+        memcpy(copy, &data[t*len], len*sizeof(REAL));
+        RNS(fft_transform)(copy, &dest[t*len], len, inverse, twiddle_cos, twiddle_sin);
+    }
+}
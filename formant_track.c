@@ -0,0 +1,434 @@
+#include "common.h"
+#define FORMANTS_FLOAT snd_real_t
+#define FORMANTS_IMPLEMENTATION
+#include "libformants.h"
+
+/*
+ * Time-varying formant analysis, modelled on Praat's "To Formant (burg)":
+ * the sound is resampled to twice the maximum formant, pre-emphasized, cut into overlapping
+ * Gaussian-windowed frames and every frame is analysed with formants_analyze from
+ * libformants (Burg LPC of order 2*nr_formants, then the roots of the predictor).
+ *
+ * Frames are independent, so they are handed out in chunks to a thread pool; every thread
+ * has its own work_t and frame buffer and writes only its own rows of the track. Within a
+ * chunk the root solver starts from the roots of the previous frame; every chunk starts
+ * cold from a seed derived from its first frame, so the track does not depend on the
+ * number of threads. The per-thread state lives in a formant_track_workspace_t that callers
+ * analysing many sounds keep around.
+ *
+ * The resampled sound, the frames and libformants itself (FORMANTS_FLOAT) are snd_real_t.
+ *
+ * Without the warm start no frame depends on another, so the predictors of all frames are
+ * computed first and their roots are then found in one go by poly_complex_solve_batch.
+ */
+
+#define FRAMES_PER_JOB 32
+#define ENVELOPE_BINS 512 /* about 11 Hz bins at the default 11 kHz analysis rate */
+#define RESAMPLE_ZERO_CROSSINGS 8
+#define RESAMPLE_CHUNK 4096
+
+void init_formant_track_params(formant_track_params_t* params) {
+    params[0].window_length = 0.025;
+    params[0].time_step = 0.00625;
+    params[0].max_formant = 5500.0;
+    params[0].nr_formants = 5;
+    params[0].preemphasis_from = 50.0;
+    params[0].nr_threads = default_thread_count();
+    params[0].warm_start = true;
+    params[0].fast = false;
+}
+
+
+
+typedef struct resample_job_t {
+    const float* input;
+    size_t stride, len;
+    snd_real_t* output;
+    size_t len_out;
+    double step;      /* input samples per output sample */
+    double cutoff;    /* relative to the input nyquist frequency */
+    double half_width; /* in input samples */
+} resample_job_t;
+
+static double sinc(double x) {
+    if(fabs(x) < 1e-12) return 1.0;
+    return sin(M_PI*x)/(M_PI*x);
+}
+
+static void resample_chunk(void* ctx, int thread_nr, size_t job_nr) {
+    resample_job_t* job = ctx;
+    size_t first = job_nr*RESAMPLE_CHUNK;
+    size_t last = first + RESAMPLE_CHUNK;
+    if(last > job[0].len_out) last = job[0].len_out;
+    for(size_t m = first; m < last; m++) {
+        double t = m*job[0].step;
+        long lo = (long) ceil(t - job[0].half_width);
+        long hi = (long) floor(t + job[0].half_width);
+        if(lo < 0) lo = 0;
+        if(hi > (long) job[0].len - 1) hi = job[0].len - 1;
+        double sum = 0.0;
+        for(long k = lo; k <= hi; k++) {
+            double d = t - k;
+            double hann = 0.5 + 0.5*cos(M_PI*d/job[0].half_width);
+            sum += job[0].input[k*job[0].stride] * job[0].cutoff*sinc(job[0].cutoff*d) * hann;
+        }
+        job[0].output[m] = sum;
+    }
+}
+
+/* band-limited resampling with a Hann windowed sinc; only ever lowers the rate */
+static snd_real_t* resample_for_analysis(const float* samples, size_t stride, size_t len, double sample_rate, double new_rate, int nr_threads, size_t* len_out) {
+    resample_job_t job;
+    job.input = samples;
+    job.stride = stride;
+    job.len = len;
+    if(new_rate >= sample_rate) {
+        job.len_out = len;
+        job.output = malloc(len*sizeof(snd_real_t));
+        for(size_t i = 0; i < len; i++) job.output[i] = samples[i*stride];
+        len_out[0] = len;
+        return job.output;
+    }
+    job.step = sample_rate/new_rate;
+    job.cutoff = new_rate/sample_rate;
+    job.half_width = RESAMPLE_ZERO_CROSSINGS*job.step;
+    job.len_out = (size_t) floor((len-1)/job.step) + 1;
+    job.output = malloc(job.len_out*sizeof(snd_real_t));
+    parallel_for((job.len_out + RESAMPLE_CHUNK-1)/RESAMPLE_CHUNK, nr_threads, resample_chunk, &job);
+    len_out[0] = job.len_out;
+    return job.output;
+}
+
+
+
+typedef struct track_job_t {
+    const snd_real_t* sound;
+    const snd_real_t* window;
+    size_t frame_len, hop;
+    double sample_rate;
+    unsigned long order;
+    bool warm_start, fast;
+    formant_track_t* track;
+    work_t** works;
+    snd_real_t** frames;
+    snd_real_t** scratch; /* fast mode: A(z), the found frequencies and bandwidths, the envelope work */
+    libf_formant_t** formants;
+    double* coefficients; /* cold mode: coefficient i of z^order A(z) of frame f at [i*nr_frames + f] */
+} track_job_t;
+
+/* fast mode: Burg as in formants_analyze, but the formants are the peaks of the envelope */
+static unsigned long envelope_formants(work_t* work, const snd_real_t* frame, size_t frame_len, unsigned long order, double sample_rate, double margin, snd_real_t* scratch, double* freqs, double* bws, int nr_formants) {
+    formants_analyze_lpc(work->lpc, frame, frame_len);
+    snd_real_t* coeffs = scratch;
+    snd_real_t* found_freqs = &scratch[order+1];
+    snd_real_t* found_bws = &scratch[order+1 + ENVELOPE_BINS/2];
+    snd_real_t* envelope_work = &scratch[order+1 + ENVELOPE_BINS];
+    coeffs[0] = 1.0;
+    for(unsigned long k = 0; k < order; k++) coeffs[k+1] = work->lpc->data[k];
+
+    size_t nr_found = lpc_envelope_formants(coeffs, order, sample_rate, ENVELOPE_BINS, found_freqs, found_bws, ENVELOPE_BINS/2, envelope_work);
+    unsigned long count = 0;
+    for(size_t i = 0; i < nr_found && count < nr_formants; i++) {
+        if(found_freqs[i] <= margin || found_freqs[i] >= sample_rate/2 - margin) continue;
+        freqs[count] = found_freqs[i];
+        bws[count] = found_bws[i];
+        count++;
+    }
+    return count;
+}
+
+static void window_frame(const track_job_t* job, size_t f, snd_real_t* frame) {
+    const snd_real_t* start = &job[0].sound[f*job[0].hop];
+    for(size_t i = 0; i < job[0].frame_len; i++) {
+        frame[i] = start[i]*job[0].window[i];
+    }
+}
+
+/* cold mode, first pass: the Burg predictor of every frame as a polynomial for the batch solver */
+static void frame_polynomials(void* ctx, int thread_nr, size_t job_nr) {
+    track_job_t* job = ctx;
+    size_t nr_frames = job[0].track[0].nr_frames;
+    work_t* work = job[0].works[thread_nr];
+    snd_real_t* frame = job[0].frames[thread_nr];
+    unsigned long order = job[0].order;
+
+    size_t first = job_nr*FRAMES_PER_JOB;
+    size_t last = first + FRAMES_PER_JOB;
+    if(last > nr_frames) last = nr_frames;
+    for(size_t f = first; f < last; f++) {
+        window_frame(job, f, frame);
+        formants_analyze_lpc(work->lpc, frame, job[0].frame_len);
+        /* libformants' monic z^order + data[0] z^(order-1) + ... + data[order-1], lowest power first */
+        for(unsigned long i = 0; i < order; i++) job[0].coefficients[i*nr_frames + f] = work->lpc->data[order-1-i];
+        job[0].coefficients[order*nr_frames + f] = 1.0;
+    }
+}
+
+/* cold mode, second pass: the formants of the roots poly_complex_solve_batch found */
+static void formants_from_batch_roots(track_job_t* job, const double* roots, const poly_solve_status_t* status) {
+    formant_track_t* track = job[0].track;
+    size_t nr_frames = track[0].nr_frames;
+    int nr_formants = track[0].nr_formants;
+    unsigned long order = job[0].order;
+    complex_t* frame_roots = malloc(order*sizeof(complex_t));
+    libf_formant_t* formants = job[0].formants[0];
+
+    for(size_t f = 0; f < nr_frames; f++) {
+        unsigned long count = 0;
+        if(status[f] == POLY_SOLVE_OK) {
+            for(unsigned long j = 0; j < order; j++) {
+                frame_roots[j] = cplx(roots[2*j*nr_frames + f], roots[(2*j+1)*nr_frames + f]);
+            }
+            formants_calculate_from_roots_into(frame_roots, order, job[0].sample_rate, 50.0, formants, &count);
+            formants_sort(formants, count);
+        }
+        double* freqs = &track[0].freqs[f*nr_formants];
+        double* bws = &track[0].bws[f*nr_formants];
+        for(int k = 0; k < nr_formants; k++) {
+            freqs[k] = (k < count) ? formants[k].frequency : NAN;
+            bws[k] = (k < count) ? formants[k].bandwidth : NAN;
+        }
+    }
+    free(frame_roots);
+}
+
+/* the LPC of every frame, then the roots of all of them at once */
+static void track_cold(track_job_t* job, int nr_threads) {
+    size_t nr_frames = job[0].track[0].nr_frames;
+    size_t nr_terms = job[0].order + 1;
+    job[0].coefficients = malloc(nr_terms*nr_frames*sizeof(double));
+    double* roots = malloc(2*job[0].order*nr_frames*sizeof(double));
+    poly_solve_status_t* status = malloc(nr_frames*sizeof(poly_solve_status_t));
+    double* work = malloc(poly_complex_solve_batch_work_size(nr_terms, nr_threads)*sizeof(double));
+
+    size_t nr_jobs = (nr_frames + FRAMES_PER_JOB-1)/FRAMES_PER_JOB;
+    parallel_for(nr_jobs, nr_threads, frame_polynomials, job);
+    poly_complex_solve_batch(job[0].coefficients, nr_frames, nr_terms, roots, status, work, nr_threads);
+    formants_from_batch_roots(job, roots, status);
+
+    free(work);
+    free(status);
+    free(roots);
+    free(job[0].coefficients);
+    job[0].coefficients = NULL;
+}
+
+static void analyze_frames(void* ctx, int thread_nr, size_t job_nr) {
+    track_job_t* job = ctx;
+    formant_track_t* track = job[0].track;
+    work_t* work = job[0].works[thread_nr];
+    snd_real_t* frame = job[0].frames[thread_nr];
+    int nr_formants = track[0].nr_formants;
+
+    size_t first = job_nr*FRAMES_PER_JOB;
+    size_t last = first + FRAMES_PER_JOB;
+    if(last > track[0].nr_frames) last = track[0].nr_frames;
+
+    formants_seed_work(work, first+1);
+    formants_set_warm_start(work, job[0].warm_start);
+    for(size_t f = first; f < last; f++) {
+        window_frame(job, f, frame);
+
+        double* freqs = &track[0].freqs[f*nr_formants];
+        double* bws = &track[0].bws[f*nr_formants];
+        if(job[0].fast) {
+            unsigned long count = envelope_formants(work, frame, job[0].frame_len, job[0].order, job[0].sample_rate, 50.0, job[0].scratch[thread_nr], freqs, bws, nr_formants);
+            for(int k = count; k < nr_formants; k++) freqs[k] = bws[k] = NAN;
+            continue;
+        }
+
+        unsigned long count = 0;
+        libf_formant_t* formants = job[0].formants[thread_nr];
+        formants_analyze_into(work, frame, job[0].frame_len, job[0].order, job[0].sample_rate, 50.0, formants, &count);
+
+        if(work->rootSolver->status != FORMANTS_ROOTS_CONVERGED) count = 0; /* roots are garbage */
+        for(int k = 0; k < nr_formants; k++) {
+            freqs[k] = (k < count) ? formants[k].frequency : NAN;
+            bws[k] = (k < count) ? formants[k].bandwidth : NAN;
+        }
+    }
+}
+
+formant_track_workspace_t create_formant_track_workspace(int nr_threads) {
+    if(nr_threads < 1) nr_threads = 1;
+    if(nr_threads > MAX_THREADS) nr_threads = MAX_THREADS;
+    formant_track_workspace_t workspace = {0};
+    workspace.nr_threads = nr_threads;
+    workspace.works = calloc(nr_threads, sizeof(work_t*));
+    workspace.frames = calloc(nr_threads, sizeof(snd_real_t*));
+    workspace.scratch = calloc(nr_threads, sizeof(snd_real_t*));
+    workspace.formants = calloc(nr_threads, sizeof(libf_formant_t*));
+    return workspace;
+}
+
+static void release_workspace_buffers(formant_track_workspace_t* workspace) {
+    for(int t = 0; t < workspace[0].nr_threads; t++) {
+        if(workspace[0].works[t] != NULL) formants_destroy_work(workspace[0].works[t]);
+        free(workspace[0].frames[t]);
+        free(workspace[0].scratch[t]);
+        free(workspace[0].formants[t]);
+        workspace[0].works[t] = NULL;
+        workspace[0].frames[t] = workspace[0].scratch[t] = NULL;
+        workspace[0].formants[t] = NULL;
+    }
+    workspace[0].frame_len = 0;
+    workspace[0].order = 0;
+}
+
+void destroy_formant_track_workspace(formant_track_workspace_t* workspace) {
+    release_workspace_buffers(workspace);
+    free(workspace[0].works);
+    free(workspace[0].frames);
+    free(workspace[0].scratch);
+    free(workspace[0].formants);
+    workspace[0].works = NULL;
+    workspace[0].frames = workspace[0].scratch = NULL;
+    workspace[0].formants = NULL;
+    workspace[0].nr_threads = 0;
+}
+
+/* the buffers only depend on the frame length and order, so they survive sound after sound */
+static void prepare_workspace(formant_track_workspace_t* workspace, size_t frame_len, unsigned long order) {
+    if(workspace[0].frame_len == frame_len && workspace[0].order == order) return;
+    release_workspace_buffers(workspace);
+    for(int t = 0; t < workspace[0].nr_threads; t++) {
+        workspace[0].works[t] = formants_make_work(frame_len, order);
+        workspace[0].frames[t] = malloc(frame_len*sizeof(snd_real_t));
+        workspace[0].scratch[t] = malloc((order+1 + ENVELOPE_BINS + lpc_envelope_work_size(ENVELOPE_BINS))*sizeof(snd_real_t));
+        workspace[0].formants[t] = malloc((order/2)*sizeof(libf_formant_t));
+    }
+    workspace[0].frame_len = frame_len;
+    workspace[0].order = order;
+}
+
+formant_track_t track_formants(const float* samples, size_t stride, size_t len, double sample_rate, const formant_track_params_t* params) {
+    formant_track_workspace_t workspace = create_formant_track_workspace(params[0].nr_threads);
+    formant_track_t track = track_formants_with(&workspace, samples, stride, len, sample_rate, params);
+    destroy_formant_track_workspace(&workspace);
+    return track;
+}
+
+/* as track_formants, with the per-thread analysis state of the workspace; uses at most
+   workspace[0].nr_threads threads */
+formant_track_t track_formants_with(formant_track_workspace_t* workspace, const float* samples, size_t stride, size_t len, double sample_rate, const formant_track_params_t* params) {
+    formant_track_t track = {0};
+    track.nr_formants = params[0].nr_formants;
+    track.time_step = params[0].time_step;
+
+    int nr_threads = params[0].nr_threads;
+    if(nr_threads < 1) nr_threads = 1;
+    if(nr_threads > workspace[0].nr_threads) nr_threads = workspace[0].nr_threads;
+    /* nothing to analyse in a sound shorter than one frame (an empty file, say) */
+    if(len < 2 || len < (size_t) round(2*params[0].window_length*sample_rate)) return track;
+    size_t sound_len;
+    snd_real_t* sound = resample_for_analysis(samples, stride, len, sample_rate, 2*params[0].max_formant, nr_threads, &sound_len);
+    double rate = (2*params[0].max_formant < sample_rate) ? 2*params[0].max_formant : sample_rate;
+
+    /* pre-emphasis, back to front so every sample still sees its unfiltered predecessor */
+    double preemphasis = exp(-2.0*M_PI*params[0].preemphasis_from/rate);
+    for(size_t i = sound_len-1; sound_len > 1 && i > 0; i--) {
+        sound[i] -= preemphasis*sound[i-1];
+    }
+
+    /* like Praat, the Gaussian window is physically twice as long as the nominal length */
+    size_t frame_len = (size_t) round(2*params[0].window_length*rate);
+    size_t hop = (size_t) round(params[0].time_step*rate);
+    unsigned long order = 2*params[0].nr_formants;
+    if(hop < 1) hop = 1;
+    if(frame_len <= order || sound_len < frame_len) {
+        free(sound);
+        return track;
+    }
+    track.nr_frames = (sound_len - frame_len)/hop + 1;
+    track.first_time = 0.5*frame_len/rate;
+    track.time_step = hop/rate;
+    track.freqs = malloc(track.nr_frames*track.nr_formants*sizeof(double));
+    track.bws = malloc(track.nr_frames*track.nr_formants*sizeof(double));
+
+    snd_real_t* window = malloc(frame_len*sizeof(snd_real_t));
+    const double edge = exp(-12.0);
+    for(size_t i = 0; i < frame_len; i++) {
+        double x = (i + 0.5)/frame_len - 0.5;
+        window[i] = (exp(-48.0*x*x) - edge)/(1.0 - edge);
+    }
+
+    track_job_t job;
+    job.sound = sound;
+    job.window = window;
+    job.frame_len = frame_len;
+    job.hop = hop;
+    job.sample_rate = rate;
+    job.order = order;
+    job.warm_start = params[0].warm_start;
+    job.fast = params[0].fast;
+    job.track = &track;
+    prepare_workspace(workspace, frame_len, order);
+    job.works = workspace[0].works;
+    job.frames = workspace[0].frames;
+    job.scratch = workspace[0].scratch;
+    job.formants = workspace[0].formants;
+    job.coefficients = NULL;
+
+    if(!job.fast && !job.warm_start) {
+        track_cold(&job, nr_threads);
+    } else {
+        parallel_for((track.nr_frames + FRAMES_PER_JOB-1)/FRAMES_PER_JOB, nr_threads, analyze_frames, &job);
+    }
+
+    free(window);
+    free(sound);
+    return track;
+}
+
+void destroy_formant_track(formant_track_t* track) {
+    free(track[0].freqs);
+    free(track[0].bws);
+    track[0].freqs = track[0].bws = NULL;
+    track[0].nr_frames = 0;
+}
+
+/* means over the frames in which the formant was found, NAN if it never was */
+void formant_track_means(const formant_track_t* track, double* mean_freqs, double* mean_bws) {
+    for(int k = 0; k < track[0].nr_formants; k++) {
+        double freq_sum = 0.0, bw_sum = 0.0;
+        size_t nr = 0;
+        for(size_t f = 0; f < track[0].nr_frames; f++) {
+            double freq = track[0].freqs[f*track[0].nr_formants + k];
+            if(isnan(freq)) continue;
+            freq_sum += freq;
+            bw_sum += track[0].bws[f*track[0].nr_formants + k];
+            nr++;
+        }
+        mean_freqs[k] = (nr > 0) ? freq_sum/nr : NAN;
+        mean_bws[k] = (nr > 0) ? bw_sum/nr : NAN;
+    }
+}
+
+/* tab separated: time, then frequency and bandwidth of every formant */
+void write_formant_track(FILE* fp, const formant_track_t* track) {
+    fprintf(fp, "time");
+    for(int k = 0; k < track[0].nr_formants; k++) {
+        fprintf(fp, "\tF%i\tB%i", k+1, k+1);
+    }
+    fprintf(fp, "\n");
+    for(size_t f = 0; f < track[0].nr_frames; f++) {
+        fprintf(fp, "%f", track[0].first_time + f*track[0].time_step);
+        for(int k = 0; k < track[0].nr_formants; k++) {
+            fprintf(fp, "\t%f\t%f", track[0].freqs[f*track[0].nr_formants + k], track[0].bws[f*track[0].nr_formants + k]);
+        }
+        fprintf(fp, "\n");
+    }
+}
+
+/* the "F1(Hz) value" lines run_on_wavs.sh collects per file, each preceded by prefix */
+void write_formant_means(FILE* fp, const formant_track_t* track, const char* prefix) {
+    double* mean_freqs = calloc(track[0].nr_formants, sizeof(double));
+    double* mean_bws = calloc(track[0].nr_formants, sizeof(double));
+    formant_track_means(track, mean_freqs, mean_bws);
+    for(int k = 0; k < track[0].nr_formants; k++) {
+        fprintf(fp, "%sF%i(Hz) %f\n", prefix, k+1, mean_freqs[k]);
+        fprintf(fp, "%sB%i(Hz) %f\n", prefix, k+1, mean_bws[k]);
+    }
+    free(mean_freqs);
+    free(mean_bws);
+}
@@ -0,0 +1,69 @@
+#include "common.h"
+
+/* tty-snd-formants:
+        read in a sound stream and print its formant tracks (time, F1, B1, F2, B2, ...) as
+        a table, followed by the mean of every formant over the whole stream
+
+        -t threads        number of analysis threads (default: all cores)
+        -w seconds        window length (default 0.025)
+        -s seconds        time step (default 0.00625)
+        -m Hz             maximum formant (default 5500)
+        -n number         number of formants (default 5)
+        -q                only print the means, as the "F1(Hz) value" lines of run_on_wavs.sh
+        -c                solve every frame on its own, all roots at once by QR, instead of
+                          starting from the last frame's roots
+        -f                fast mode: peaks of the LPC envelope instead of root solving
+*/
+
+
+
+int main(int argc, char** argv) {
+    formant_track_params_t params;
+    init_formant_track_params(&params);
+    bool only_means = false;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-q") == 0) {
+            only_means = true;
+        } else if(strcmp(argv[i], "-c") == 0) {
+            params.warm_start = false;
+        } else if(strcmp(argv[i], "-f") == 0) {
+            params.fast = true;
+        } else if(i+1 < argc && strcmp(argv[i], "-t") == 0) {
+            params.nr_threads = atoi(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-w") == 0) {
+            params.window_length = atof(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-s") == 0) {
+            params.time_step = atof(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-m") == 0) {
+            params.max_formant = atof(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-n") == 0) {
+            params.nr_formants = atoi(argv[++i]);
+        } else {
+            die("usage: tty-snd-formants [-t threads] [-w window-length] [-s time-step] [-m max-formant] [-n nr-formants] [-q] [-c] [-f]\n");
+        }
+    }
+    assert(params.window_length > 0 && params.time_step > 0 && params.max_formant > 0 && params.nr_formants > 0);
+
+    simple_wav_t float_form = read_simple_wav(stdin);
+
+    /* samples are complex, the sound is in the real parts */
+    size_t len = float_form.nr_sample_points / 2;
+    formant_track_t track = track_formants(float_form.samples, 2, len, float_form.frequency_in_hz, &params);
+    if(track.nr_frames == 0) {
+        fprintf(stderr, "stream too short for a single analysis window!\n");
+    }
+
+    if(only_means) {
+        write_formant_means(stdout, &track, "");
+    } else {
+        write_formant_track(stdout, &track);
+        write_formant_means(stdout, &track, "#");
+    }
+
+    destroy_formant_track(&track);
+    free(float_form.samples);
+    free(float_form.peaks);
+
+    return 0;
+}
@@ -0,0 +1,232 @@
+/* gauss.c, instantiated once per precision: REAL is the element type, MATRIX the matrix type,
+   LU the matching factorization and RNS(name) the suffixed name */
+
+MATRIX RNS(create_matrix)(int width, int height) {
+    MATRIX ret;
+    ret.width = width;
+    ret.height = height;
+    ret.data = calloc(width*height,sizeof(REAL));
+    return ret;
+}
+void RNS(destroy_matrix)(MATRIX mat) {
+    free(mat.data);
+}
+MATRIX RNS(copy_matrix)(MATRIX mat) {
+    MATRIX ret;
+    ret.width = mat.width;
+    ret.height = mat.height;
+    ret.data = calloc(mat.width*mat.height,sizeof(REAL));
+    memcpy(ret.data, mat.data, mat.width*mat.height*sizeof(REAL));
+    return ret;
+}
+void RNS(print_matrix)(MATRIX mat) {
+    for(int col = 0; col < mat.width; col++) {
+        for(int row = 0; row < mat.height; row++) {
+            printf("%f,", RNS(get)(mat, col, row));
+        }
+        printf("\n");
+    }
+    printf("\n");
+}
+
+
+
+/*
+ * The data is column-major, so every kernel below runs down columns: the innermost loops
+ * are unit stride and the only strided accesses left are the row swaps of the pivoting,
+ * once per column.
+ */
+
+static void RNS(swap_rows)(MATRIX mat, int row1, int row2) {
+    if(row1 == row2) return;
+    for(int col = 0; col < mat.width; col++) {
+        REAL* column = &mat.data[col*mat.height];
+        REAL tmp = column[row1];
+        column[row1] = column[row2];
+        column[row2] = tmp;
+    }
+}
+
+/* LU factorization with partial pivoting, PA = LU with the unit lower L and U in one matrix;
+   a copy, so the factors can solve any number of right-hand sides later */
+LU RNS(lu_decompose)(MATRIX mat_input) {
+    assert(mat_input.width == mat_input.height);
+    int n = mat_input.width;
+    LU ret;
+    ret.lu = RNS(copy_matrix)(mat_input);
+    ret.pivots = malloc((n > 0 ? n : 1)*sizeof(int));
+    ret.singular = false;
+    REAL* a = ret.lu.data;
+
+    for(int k = 0; k < n; k++) {
+        REAL* column_k = &a[k*n];
+        int pivot = k;
+        for(int row = k+1; row < n; row++) {
+            if(fabs(column_k[row]) > fabs(column_k[pivot])) pivot = row;
+        }
+        ret.pivots[k] = pivot;
+        if(column_k[pivot] == 0.0) {
+            ret.singular = true;
+            continue;
+        }
+        RNS(swap_rows)(ret.lu, k, pivot);
+
+        REAL inverse = 1/column_k[k];
+        for(int row = k+1; row < n; row++) {
+            column_k[row] *= inverse;
+        }
+        for(int col = k+1; col < n; col++) {
+            REAL* column = &a[col*n];
+            REAL factor = column[k];
+            if(factor == 0.0) continue;
+            for(int row = k+1; row < n; row++) {
+                column[row] -= column_k[row]*factor;
+            }
+        }
+    }
+    return ret;
+}
+
+void RNS(destroy_lu)(LU lu) {
+    RNS(destroy_matrix)(lu.lu);
+    free(lu.pivots);
+}
+
+/* overwrites every column of rhs with the solution of mat x = column */
+void RNS(lu_solve)(LU lu, MATRIX rhs) {
+    int n = lu.lu.width;
+    assert(rhs.height == n && !lu.singular);
+    const REAL* a = lu.lu.data;
+    for(int k = 0; k < n; k++) {
+        RNS(swap_rows)(rhs, k, lu.pivots[k]);
+    }
+    for(int j = 0; j < rhs.width; j++) {
+        REAL* x = &rhs.data[j*n];
+        for(int k = 0; k < n; k++) {
+            const REAL* column = &a[k*n];
+            REAL xk = x[k];
+            if(xk == 0.0) continue;
+            for(int row = k+1; row < n; row++) {
+                x[row] -= column[row]*xk;
+            }
+        }
+        for(int k = n-1; k >= 0; k--) {
+            const REAL* column = &a[k*n];
+            x[k] /= column[k];
+            REAL xk = x[k];
+            for(int row = 0; row < k; row++) {
+                x[row] -= column[row]*xk;
+            }
+        }
+    }
+}
+
+/* in place: the lower triangle becomes L with mat = L L^T, the upper one is zeroed;
+   false if mat is not (numerically) symmetric positive definite */
+bool RNS(cholesky_decompose)(MATRIX mat) {
+    assert(mat.width == mat.height);
+    int n = mat.width;
+    REAL* a = mat.data;
+    for(int k = 0; k < n; k++) {
+        REAL* column_k = &a[k*n];
+        if(!(column_k[k] > 0.0)) return false;
+        REAL diagonal = sqrt(column_k[k]);
+        column_k[k] = diagonal;
+        REAL inverse = 1/diagonal;
+        for(int row = k+1; row < n; row++) {
+            column_k[row] *= inverse;
+        }
+        for(int col = k+1; col < n; col++) {
+            REAL* column = &a[col*n];
+            REAL factor = column_k[col];
+            for(int row = col; row < n; row++) {
+                column[row] -= column_k[row]*factor;
+            }
+        }
+    }
+    for(int col = 1; col < n; col++) {
+        memset(&a[col*n], 0, col*sizeof(REAL));
+    }
+    return true;
+}
+
+/* overwrites every column of rhs with the solution of L L^T x = column */
+void RNS(cholesky_solve)(MATRIX chol, MATRIX rhs) {
+    int n = chol.width;
+    assert(rhs.height == n);
+    const REAL* l = chol.data;
+    for(int j = 0; j < rhs.width; j++) {
+        REAL* x = &rhs.data[j*n];
+        for(int k = 0; k < n; k++) {
+            const REAL* column = &l[k*n];
+            x[k] /= column[k];
+            REAL xk = x[k];
+            for(int row = k+1; row < n; row++) {
+                x[row] -= column[row]*xk;
+            }
+        }
+        for(int k = n-1; k >= 0; k--) {
+            const REAL* column = &l[k*n];
+            REAL sum = x[k];
+            for(int row = k+1; row < n; row++) {
+                sum -= column[row]*x[row];
+            }
+            x[k] = sum/column[k];
+        }
+    }
+}
+
+
+
+MATRIX RNS(gaussian)(MATRIX mat_input, MATRIX v) {
+    assert(v.width == 1);
+    assert((mat_input.width == mat_input.height) && (mat_input.height == v.height));
+    LU lu = RNS(lu_decompose)(mat_input);
+    if(lu.singular) die("matrix inadequate!\n");
+    MATRIX res = RNS(copy_matrix)(v);
+    RNS(lu_solve)(lu, res);
+    RNS(destroy_lu)(lu);
+    return res;
+}
+
+MATRIX RNS(invert_matrix)(MATRIX mat_input) {
+    assert(mat_input.width == mat_input.height);
+    LU lu = RNS(lu_decompose)(mat_input);
+    if(lu.singular) die("matrix inadequate!\n");
+    MATRIX res = RNS(create_matrix)(mat_input.width,mat_input.height);
+    for(int i = 0; i < mat_input.width; i++) {
+        RNS(set)(res, i, i, 1.0);
+    }
+    RNS(lu_solve)(lu, res);
+    RNS(destroy_lu)(lu);
+    return res;
+}
+
+
+
+/* res = a b, blocked so that a MATRIX_BLOCK x MATRIX_BLOCK tile of a stays in cache while it is
+   applied to every column of b */
+MATRIX RNS(matrix_multiply)(MATRIX a, MATRIX b) {
+    assert(a.width == b.height);
+    MATRIX res = RNS(create_matrix)(b.width, a.height);
+    int m = a.height;
+    for(int row0 = 0; row0 < m; row0 += MATRIX_BLOCK) {
+        int row1 = (row0 + MATRIX_BLOCK < m) ? row0 + MATRIX_BLOCK : m;
+        for(int k0 = 0; k0 < a.width; k0 += MATRIX_BLOCK) {
+            int k1 = (k0 + MATRIX_BLOCK < a.width) ? k0 + MATRIX_BLOCK : a.width;
+            for(int j = 0; j < b.width; j++) {
+                REAL* out = &res.data[j*m];
+                const REAL* b_column = &b.data[j*b.height];
+                for(int k = k0; k < k1; k++) {
+                    REAL factor = b_column[k];
+                    if(factor == 0.0) continue;
+                    const REAL* a_column = &a.data[k*m];
+                    for(int row = row0; row < row1; row++) {
+                        out[row] += a_column[row]*factor;
+                    }
+                }
+            }
+        }
+    }
+    return res;
+}
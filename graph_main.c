@@ -1,27 +1,137 @@
 #include "common.h"
 
+/* tty-snd-graph:
+        draws the magnitudes of the complex stream on stdin, normalized, in a window
+
+        mouse wheel       zoom in and out around the mouse
+        drag, left/right  pan
+        home              the whole stream again
+
+        The stream is put into a min/max pyramid once (minmax_pyramid.c); a frame draws the
+        minimum and maximum of every pixel column of the visible range, from the level of the
+        pyramid that fits the zoom, so a redraw costs the same for a thousand and a hundred
+        million samples. Zoomed in to less than a sample per column, the samples themselves
+        are drawn.
+*/
+
+#define GRAPH_MARGIN 15.0f
+
 int main(int argc, char** argv) {
     simple_wav_t float_form = read_simple_wav(stdin);
+    size_t len = float_form.nr_sample_points/2;
+    if(len == 0) die("nothing to draw!\n");
 
 
     int _width = 500, _height = 500;
-    SetConfigFlags(FLAG_MSAA_4X_HINT);
+    SetConfigFlags(FLAG_MSAA_4X_HINT | FLAG_WINDOW_RESIZABLE);
     InitWindow(_width, _height, "graph display");
     SetTargetFPS(30);
 
-    float* combined_frequencies = compute_complex_absolute_values(float_form.samples, float_form.nr_sample_points/2);
-    float* normalized_data = normalize_float_array(combined_frequencies, float_form.nr_sample_points/2);
-    Vector2* normalized_graph = create_graph_from_float_array(normalized_data, float_form.nr_sample_points/2, 15.0f, 350.0f, 350.0f, 200.0f);
+    float* combined_frequencies = compute_complex_absolute_values(float_form.samples, len);
+    float* normalized_data = normalize_float_array(combined_frequencies, len);
+    minmax_pyramid_t pyramid;
+    create_minmax_pyramid(&pyramid, normalized_data, len);
+
+    /* the visible samples [first, first+span) */
+    double first = 0.0, span = len;
+    size_t nr_columns = 0;
+    float* col_min = NULL;
+    float* col_max = NULL;
+    Vector2* graph = NULL;
+    size_t nr_points = 0;
+    int level = 0;
+    bool changed = true;
+    char info[128];
 
     while(!WindowShouldClose()) {
+        float width = GetScreenWidth() - 2*GRAPH_MARGIN;
+        float base_y = 0.7f*GetScreenHeight();
+        float max_y = 0.4f*GetScreenHeight();
+        if(width < 1.0f) width = 1.0f;
+
+        float wheel = GetMouseWheelMove();
+        if(wheel != 0.0f) {
+            /* the sample under the mouse stays where it is */
+            double at = first + span*(GetMouseX() - GRAPH_MARGIN)/width;
+            double new_span = span*pow(0.8, wheel);
+            if(new_span < 4.0) new_span = 4.0;
+            if(new_span > len) new_span = len;
+            first = at - (at - first)*new_span/span;
+            span = new_span;
+            changed = true;
+        }
+        if(IsMouseButtonDown(MOUSE_BUTTON_LEFT)) {
+            Vector2 delta = GetMouseDelta();
+            if(delta.x != 0.0f) {
+                first -= span*delta.x/width;
+                changed = true;
+            }
+        }
+        if(IsKeyDown(KEY_LEFT) || IsKeyDown(KEY_RIGHT)) {
+            first += (IsKeyDown(KEY_RIGHT) ? 0.02 : -0.02)*span;
+            changed = true;
+        }
+        if(IsKeyPressed(KEY_HOME)) {
+            first = 0.0;
+            span = len;
+            changed = true;
+        }
+        if((size_t) width != nr_columns) {
+            nr_columns = (size_t) width;
+            col_min = realloc(col_min, nr_columns*sizeof(float));
+            col_max = realloc(col_max, nr_columns*sizeof(float));
+            graph = realloc(graph, 2*nr_columns*sizeof(Vector2));
+            changed = true;
+        }
+        if(first < 0.0) first = 0.0;
+        if(first + span > len) first = len - span;
+
+        /* the points only change with the view */
+        if(changed) {
+            changed = false;
+            nr_points = 0;
+            if(span >= nr_columns) {
+                /* every column from its minimum to its maximum, in a zigzag the line goes through */
+                level = minmax_pyramid_columns(&pyramid, first, first + span, nr_columns, col_min, col_max);
+                for(size_t c = 0; c < nr_columns; c++) {
+                    float x = GRAPH_MARGIN + c;
+                    bool down = (c % 2 == 0);
+                    graph[nr_points].x = x;
+                    graph[nr_points++].y = base_y - max_y*(down ? col_max[c] : col_min[c]);
+                    graph[nr_points].x = x;
+                    graph[nr_points++].y = base_y - max_y*(down ? col_min[c] : col_max[c]);
+                }
+            } else {
+                level = 0;
+                size_t lo = (size_t) floor(first);
+                size_t hi = (size_t) ceil(first + span);
+                if(hi > len-1) hi = len-1;
+                for(size_t i = lo; i <= hi && nr_points < 2*nr_columns; i++) {
+                    graph[nr_points].x = GRAPH_MARGIN + (float)((i - first)/span*width);
+                    graph[nr_points++].y = base_y - max_y*normalized_data[i];
+                }
+            }
+            snprintf(info, sizeof(info), "samples %.0f - %.0f of %zu, level %i", first, first + span, len, level);
+        }
+
         BeginDrawing();
 
         ClearBackground(RAYWHITE);
-        DrawSplineLinear(normalized_graph, float_form.nr_sample_points/2, 1.0f, BLUE);
+        if(nr_points >= 2) DrawSplineLinear(graph, nr_points, 1.0f, BLUE);
+        DrawText(info, GRAPH_MARGIN, 10, 10, DARKGRAY);
 
         EndDrawing();
     }
     CloseWindow();
 
+    destroy_minmax_pyramid(&pyramid);
+    free(col_min);
+    free(col_max);
+    free(graph);
+    free(combined_frequencies);
+    free(normalized_data);
+    free(float_form.samples);
+    free(float_form.peaks);
+
     return 0;
 }
@@ -4,7 +4,20 @@
 /* curtesy of the in-formant project: https://github.com/in-formant/in-formant */
 
 
-double* autocorr_solve(const double *data, int length, int lpcOrder, double *pGain, size_t* out_nr_formants)
+/* scratch sizes (in doubles) for the *_into variants, so callers can keep one buffer per frame loop */
+size_t autocorr_work_size(int lpcOrder) {
+    return 3*(lpcOrder+2);
+}
+size_t covar_work_size(int lpcOrder) {
+    return (1 + (lpcOrder * (lpcOrder + 1) / 2)) + 2*(1 + lpcOrder) + 2*(1 + (lpcOrder + 1));
+}
+size_t burg_work_size(int lpcOrder, int length) {
+    return 2*(1 + length) + (1 + lpcOrder);
+}
+
+
+/* work needs autocorr_work_size(lpcOrder) doubles, lpc_out lpcOrder; returns the order reached */
+int autocorr_solve_into(const double *data, int length, int lpcOrder, double *lpc_out, double *pGain, double *work)
 {
     double gain;
     int i, j;
@@ -12,11 +25,10 @@ double* autocorr_solve(const double *data, int length, int lpcOrder, double *pGa
     const int n = length;
     const int m = lpcOrder;
 
-    printf("allocate size: %zu\n", (m+2)*sizeof(double));
-    double* r = calloc(m+2, sizeof(double));
-    printf("bug here");
-    double* a = calloc(m+2, sizeof(double));
-    double* rc = calloc(m+2, sizeof(double));
+    double* r = &work[0];
+    double* a = &work[m+2];
+    double* rc = &work[2*(m+2)];
+    memset(work, 0, autocorr_work_size(m)*sizeof(double));
 
     j = m + 1;
     while (j--) {
@@ -57,42 +69,39 @@ end:
     if (pGain != nullptr)
         *pGain = gain;
 
-
-    out_nr_formants[0] = i;
-    double* lpc = calloc(i, sizeof(double));
-
     for (j = 1; j <= i; ++j)
-       lpc[j - 1] = a[j + 1];
-
-
-
-    free(r);
-    free(a);
-    free(rc);
-
+       lpc_out[j - 1] = a[j + 1];
 
+    return i;
+}
 
+double* autocorr_solve(const double *data, int length, int lpcOrder, double *pGain, size_t* out_nr_formants)
+{
+    double* work = calloc(autocorr_work_size(lpcOrder), sizeof(double));
+    double* lpc = calloc(lpcOrder, sizeof(double));
+    out_nr_formants[0] = autocorr_solve_into(data, length, lpcOrder, lpc, pGain, work);
+    free(work);
     return lpc;
 }
 
 
 
 
-double* Covar_solve(const double *data, int length, int lpcOrder, double *pGain, size_t* out_nr_formants)
-
+/* work needs covar_work_size(lpcOrder) doubles, lpc_out lpcOrder; returns the order reached */
+int Covar_solve_into(const double *data, int length, int lpcOrder, double *lpc_out, double *pGain, double *work)
 {
-
     double gain;
     int i, j, k;
 
     const int n = length;
     const int m = lpcOrder;
 
-    double* b = calloc(1 + (m * (m + 1) / 2), sizeof(double));
-    double* grc = calloc(1 + (m), sizeof(double));
-    double* beta = calloc(1 + (m), sizeof(double));
-    double* a = calloc(1 + (m + 1), sizeof(double));
-    double* cc = calloc(1 + (m + 1), sizeof(double));
+    double* b = &work[0];
+    double* grc = &b[1 + (m * (m + 1) / 2)];
+    double* beta = &grc[1 + m];
+    double* a = &beta[1 + m];
+    double* cc = &a[1 + (m + 1)];
+    memset(work, 0, covar_work_size(m)*sizeof(double));
 
 
     // Simulating index-1-based array.
@@ -168,41 +177,124 @@ end:
     if (pGain != nullptr)
         *pGain = gain;
 
-
-    out_nr_formants[0] = i;
-    double* lpc = calloc(i, sizeof(double));
-
     for (j = 1; j <= i; ++j)
-       lpc[j - 1] = a[j + 1];
+       lpc_out[j - 1] = a[j + 1];
 
+    return i;
+}
 
+double* Covar_solve(const double *data, int length, int lpcOrder, double *pGain, size_t* out_nr_formants)
+{
+    double* work = calloc(covar_work_size(lpcOrder), sizeof(double));
+    double* lpc = calloc(lpcOrder, sizeof(double));
+    out_nr_formants[0] = Covar_solve_into(data, length, lpcOrder, lpc, pGain, work);
+    free(work);
+    return lpc;
+}
 
-    free(b);
-    free(grc);
-    free(beta);
-    free(a);
-    free(cc);
 
 
-    return lpc;
-}
 
 
+/*
+ * Burg kernels. The sums for the reflection coefficient of the next order are taken in the
+ * same pass that updates the forward and backward errors, so every order reads b1/b2 once
+ * instead of twice. Four independent accumulators per sum (two vectors of two lanes with GCC
+ * vector extensions) break the serial dependency chain of a single running sum.
+ */
+#if defined(__GNUC__)
+typedef double burg_v2d __attribute__((vector_size(16)));
+typedef double burg_v2d_u __attribute__((vector_size(16), aligned(8)));
+#define BURG_LOAD(p) (*(const burg_v2d_u*) (p))
+#define BURG_STORE(p, v) (*(burg_v2d_u*) (p) = (v))
+#endif
 
+/* num = sum b1[j]*b2[j], denum = sum b1[j]^2 + b2[j]^2 over j < count */
+static void burg_dot(const double* b1, const double* b2, int count, double* num_out, double* denum_out)
+{
+    int j = 0;
+    double num = 0.0, denum = 0.0;
+#if defined(__GNUC__)
+    burg_v2d num0 = {0.0, 0.0}, num1 = {0.0, 0.0}, den0 = {0.0, 0.0}, den1 = {0.0, 0.0};
+    for (; j + 4 <= count; j += 4) {
+        burg_v2d f0 = BURG_LOAD(&b1[j]), f1 = BURG_LOAD(&b1[j + 2]);
+        burg_v2d g0 = BURG_LOAD(&b2[j]), g1 = BURG_LOAD(&b2[j + 2]);
+        num0 += f0 * g0;
+        num1 += f1 * g1;
+        den0 += f0 * f0 + g0 * g0;
+        den1 += f1 * f1 + g1 * g1;
+    }
+    num0 += num1;
+    den0 += den1;
+    num = num0[0] + num0[1];
+    denum = den0[0] + den0[1];
+#endif
+    for (; j < count; ++j) {
+        num += b1[j] * b2[j];
+        denum += b1[j] * b1[j] + b2[j] * b2[j];
+    }
+    *num_out = num;
+    *denum_out = denum;
+}
 
+/*
+ * b1[j] -= k*b2[j], b2[j] = b2[j+1] - k*b1[j+1] (with the old b1[j+1]) for j < count, and the
+ * sums of burg_dot over the updated values; b1 and b2 must be readable up to index count
+ */
+static void burg_update_dot(double* b1, double* b2, int count, double k, double* num_out, double* denum_out)
+{
+    int j = 0;
+    double num = 0.0, denum = 0.0;
+#if defined(__GNUC__)
+    burg_v2d kk = {k, k};
+    burg_v2d num0 = {0.0, 0.0}, num1 = {0.0, 0.0}, den0 = {0.0, 0.0}, den1 = {0.0, 0.0};
+    for (; j + 4 <= count; j += 4) {
+        /* load everything first: b1[j+1..j+4] have to be the old values */
+        burg_v2d f0 = BURG_LOAD(&b1[j]), f1 = BURG_LOAD(&b1[j + 2]);
+        burg_v2d g0 = BURG_LOAD(&b2[j]), g1 = BURG_LOAD(&b2[j + 2]);
+        burg_v2d fn0 = BURG_LOAD(&b1[j + 1]), fn1 = BURG_LOAD(&b1[j + 3]);
+        burg_v2d gn0 = BURG_LOAD(&b2[j + 1]), gn1 = BURG_LOAD(&b2[j + 3]);
+        f0 -= kk * g0;
+        f1 -= kk * g1;
+        g0 = gn0 - kk * fn0;
+        g1 = gn1 - kk * fn1;
+        BURG_STORE(&b1[j], f0);
+        BURG_STORE(&b1[j + 2], f1);
+        BURG_STORE(&b2[j], g0);
+        BURG_STORE(&b2[j + 2], g1);
+        num0 += f0 * g0;
+        num1 += f1 * g1;
+        den0 += f0 * f0 + g0 * g0;
+        den1 += f1 * f1 + g1 * g1;
+    }
+    num0 += num1;
+    den0 += den1;
+    num = num0[0] + num0[1];
+    denum = den0[0] + den0[1];
+#endif
+    for (; j < count; ++j) {
+        b1[j] -= k * b2[j];
+        b2[j] = b2[j + 1] - k * b1[j + 1];
+        num += b1[j] * b2[j];
+        denum += b1[j] * b1[j] + b2[j] * b2[j];
+    }
+    *num_out = num;
+    *denum_out = denum;
+}
 
 static double vecBurgBuffered(
         double *lpc,
         const int m,
         const double *data,
-        const int n)
+        const int n,
+        double *work)
 {
     int i, j;
 
-
-    double* b1 = calloc(1+n, sizeof(double));
-    double* b2 = calloc(1+n, sizeof(double));
-    double* aa = calloc(1+m, sizeof(double));
+    double* b1 = &work[0];
+    double* b2 = &work[1+n];
+    double* aa = &work[2*(1+n)];
+    memset(work, 0, burg_work_size(m, n)*sizeof(double));
 
     // Simulating index-1-based array.
     double *a = &lpc[-1];
@@ -214,7 +306,6 @@ static double vecBurgBuffered(
 
     double xms = p / n;
     if (xms <= 0.0) {
-        free(b1); free(b2); free(aa);
         return xms;
     }
 
@@ -223,15 +314,11 @@ static double vecBurgBuffered(
     for (j = 2; j <= n - 1; ++j)
         b1[j] = b2[j - 1] = x[j];
 
-    for (i = 1; i <= m; ++i) {
-        double num = 0.0, denum = 0.0;
-        for (j = 1; j <= n - i; ++j) {
-            num += b1[j] * b2[j];
-            denum += b1[j] * b1[j] + b2[j] * b2[j];
-        }
+    double num, denum;
+    burg_dot(&b1[1], &b2[1], n - 1, &num, &denum);
 
+    for (i = 1; i <= m; ++i) {
         if (denum <= 0.0) {
-            free(b1); free(b2); free(aa);
             return 0.0;
         }
 
@@ -245,45 +332,49 @@ static double vecBurgBuffered(
         if (i < m) {
             for (j = 1; j <= i; ++j)
                 aa[j] = a[j];
-            for (j = 1; j <= n - i - 1; ++j) {
-                b1[j] -= aa[i] * b2[j];
-                b2[j] = b2[j + 1] - aa[i] * b1[j + 1];
-            }
+            /* the sums for order i+1 come out of the update */
+            burg_update_dot(&b1[1], &b2[1], n - i - 1, aa[i], &num, &denum);
         }
     }
 
-    free(b1); free(b2); free(aa);
     return xms;
 }
 
-double* Burg_solve(const double *x, int length, int lpcOrder, double *pGain, size_t* out_nr_formants)
+/* work needs burg_work_size(lpcOrder, length) doubles, lpc_out lpcOrder; returns the order reached */
+int Burg_solve_into(const double *x, int length, int lpcOrder, double *lpc_out, double *pGain, double *work)
 {
     const int n = length;
     const int m = lpcOrder;
+    int nr_formants;
 
-    double* lpc = calloc(m, sizeof(double));
-
-    double gain = vecBurgBuffered(lpc, m, x, n);
+    memset(lpc_out, 0, m*sizeof(double));
+    double gain = vecBurgBuffered(lpc_out, m, x, n, work);
 
 
     if (gain <= 0.0) {
-        out_nr_formants[0] = 0;
+        nr_formants = 0;
         gain = 1e-10;
     } else {
-        out_nr_formants[0] = m;
+        nr_formants = m;
     }
 
     gain *= n;
 
-    for (int i = 0; i < out_nr_formants[0]; i++) {
-        lpc[i] *= -1;
+    for (int i = 0; i < nr_formants; i++) {
+        lpc_out[i] *= -1;
     }
 
     if (pGain != NULL)
         *pGain = gain;
 
-    return lpc;
+    return nr_formants;
 }
 
-
-
+double* Burg_solve(const double *x, int length, int lpcOrder, double *pGain, size_t* out_nr_formants)
+{
+    double* work = calloc(burg_work_size(lpcOrder, length), sizeof(double));
+    double* lpc = calloc(lpcOrder, sizeof(double));
+    out_nr_formants[0] = Burg_solve_into(x, length, lpcOrder, lpc, pGain, work);
+    free(work);
+    return lpc;
+}
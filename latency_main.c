@@ -0,0 +1,295 @@
+#include "common.h"
+#include <unistd.h>
+
+/* tty-snd-latency:
+        measures how long a sound takes through the capture, detection and playback path.
+        Impulses are injected at known times, captured through the ring of capture.c, read hop
+        by hop as tty-snd-live reads them and found by a threshold on the samples of every hop;
+        every impulse found is answered by playing an impulse of opposite sign, which comes back through the capture like a speaker
+        picked up by the microphone. Each stage boundary is timestamped per impulse, and the
+        percentiles and the jitter of every stage are reported per capture buffer size.
+
+        tty-snd-latency [-L] [-r rate] [-k frames,frames,...] [-s hop] [-i impulses]
+                        [-t interval] [-b budget-ms]
+
+        -L                inject through an ALC_SOFT_loopback device (loopback.c), so the OpenAL
+                          mixer is measured as well; by default a synthetic source stands in for it
+        -r Hz             sample rate (default 44100)
+        -k frames         the capture buffer sizes to measure, comma separated
+                          (default 64,128,256,512,1024)
+        -s frames         hop, the frames read at a time (default 512)
+        -i impulses       per buffer size (default 20)
+        -t seconds        between two impulses (default 0.1)
+        -b ms             round trip budget (default 20)
+
+        Both sources are rendered in real time, period n when a device would deliver it, (n+1)
+        periods after the start. The stages of an impulse are
+        capture           from the time it sounds until its period is in the ring
+        buffering         from there until the hop it is in has been read
+        detection         the threshold search of the hop
+        playback          from playing the answer until the answer is in the ring
+        round trip        from the impulse sounding until its answer is found
+*/
+
+#define LATENCY_STAGES 5
+#define LATENCY_IMPULSE 0.5f
+
+static const char* stage_names[LATENCY_STAGES] = {"capture", "buffering", "detection", "playback", "round trip"};
+enum { STAGE_CAPTURE, STAGE_BUFFERING, STAGE_DETECTION, STAGE_PLAYBACK, STAGE_ROUND_TRIP };
+
+/* the impulse train, rendered by the capture thread a period at a time */
+typedef struct impulse_source_t {
+    loopback_t* loopback;       /* NULL for the synthetic source */
+    ALuint answer_source, answer_buffer;    /* of the loopback */
+    atomic_bool answer_pending; /* of the synthetic source, mixed into the next period */
+    size_t period_frames;
+    size_t interval_frames;     /* impulse k sounds at frame (k+1)*interval_frames */
+    size_t total_frames;
+    size_t rendered_frames;     /* capture thread only */
+    double* period_times;       /* monotonic_seconds when period n was rendered, just before it went into the ring */
+} impulse_source_t;
+
+static void render_impulses(void* arg, void* frames, size_t nr_frames) {
+    impulse_source_t* source = arg;
+    size_t first = source[0].rendered_frames;
+    if(source[0].loopback != NULL) {
+        loopback_render(source[0].loopback, frames, nr_frames);
+    } else {
+        float* out = frames;
+        memset(out, 0, nr_frames*sizeof(float));
+        size_t next = (first/source[0].interval_frames + 1)*source[0].interval_frames;
+        for(size_t f = next; f < first + nr_frames && f < source[0].total_frames; f += source[0].interval_frames) {
+            out[f - first] = LATENCY_IMPULSE;
+        }
+        if(atomic_exchange(&source[0].answer_pending, false)) out[0] -= LATENCY_IMPULSE;
+    }
+    source[0].period_times[first/source[0].period_frames] = monotonic_seconds();
+    source[0].rendered_frames += nr_frames;
+}
+
+static bool impulses_playing(void* arg) {
+    impulse_source_t* source = arg;
+    if(source[0].loopback != NULL) return loopback_playing(source[0].loopback);
+    return source[0].rendered_frames < source[0].total_frames;
+}
+
+static void play_answer(impulse_source_t* source) {
+    if(source[0].loopback != NULL) {
+        alSourcePlay(source[0].answer_source);
+    } else {
+        atomic_store(&source[0].answer_pending, true);
+    }
+}
+
+/* the impulse train as a stream, and the answer as a buffer on a source of its own */
+static void prepare_loopback_impulses(impulse_source_t* source, int rate) {
+    simple_wav_t train = {0};
+    train.frequency_in_hz = (float) rate;
+    train.nr_sample_points = 2*source[0].total_frames;
+    train.samples = calloc(train.nr_sample_points, sizeof(float));
+    for(size_t f = source[0].interval_frames; f < source[0].total_frames; f += source[0].interval_frames) {
+        train.samples[2*f] = LATENCY_IMPULSE;
+    }
+    loopback_play_stream(source[0].loopback, &train);
+    free(train.samples);
+
+    bool use_float = alIsExtensionPresent("AL_EXT_FLOAT32");
+    float float_answer = -LATENCY_IMPULSE;
+    int16_t int_answer = (int16_t) floorf(-LATENCY_IMPULSE*INT16_MAX);
+    sample_format_t format = {1, use_float};
+    alGenBuffers(1, &source[0].answer_buffer);
+    alBufferData(source[0].answer_buffer, al_sample_format(format), use_float ? (void*) &float_answer : (void*) &int_answer, sample_frame_size(format), rate);
+    alGenSources(1, &source[0].answer_source);
+    alSourcei(source[0].answer_source, AL_BUFFER, source[0].answer_buffer);
+    if(alGetError() != AL_NO_ERROR) die("could not prepare the answer on the loopback device!\n");
+}
+
+/* stage_ms[stage][i] for the impulses of one run; NAN where a stage was not reached */
+typedef struct latency_run_t {
+    size_t nr_impulses;
+    float* stage_ms[LATENCY_STAGES];
+    size_t nr_found, nr_answered;
+} latency_run_t;
+
+/* the detecting side of one run: reads hop after hop until the capture has stopped */
+static void detect_impulses(capture_t* capture, sample_format_t format, impulse_source_t* source, size_t hop, latency_run_t* run) {
+    double rate = capture[0].sample_rate;
+    uint8_t* pcm = malloc(hop*capture[0].frame_size);
+    float* newest = malloc(hop*sizeof(float));
+
+    size_t frame_base = 0;      /* stream position of the newest hop */
+    long answering = -1;        /* the impulse whose answer is on its way */
+    double answer_time = 0.0;
+    while(true) {
+        size_t got = 0;
+        while(got < hop) {
+            size_t nr = capture_read(capture, &pcm[got*capture[0].frame_size], hop - got);
+            if(nr == 0) break;
+            got += nr;
+        }
+        if(got < hop) break;
+        double read_time = monotonic_seconds();
+
+        /* the impulses and answers that came in with the hop */
+        frames_to_mono(pcm, hop, format, newest, 1);
+        for(size_t i = 0; i < hop; i++) {
+            if(fabsf(newest[i]) < 0.5f*LATENCY_IMPULSE) continue;
+            double found_time = monotonic_seconds();
+            size_t frame = frame_base + i;
+            double arrival_time = source[0].period_times[frame/source[0].period_frames];
+            if(newest[i] > 0.0f) {
+                /* the nearest impulse; a resampler may have moved it by a few frames */
+                long k = lround((double) frame/source[0].interval_frames) - 1;
+                if(k < 0 || k >= (long) run[0].nr_impulses || !isnan(run[0].stage_ms[STAGE_CAPTURE][k])) continue;
+                double sound_time = capture[0].start_time + (k+1)*source[0].interval_frames/rate;
+                run[0].stage_ms[STAGE_CAPTURE][k] = 1000.0*(arrival_time - sound_time);
+                run[0].stage_ms[STAGE_BUFFERING][k] = 1000.0*(read_time - arrival_time);
+                run[0].stage_ms[STAGE_DETECTION][k] = 1000.0*(found_time - read_time);
+                run[0].nr_found++;
+                answering = k;
+                answer_time = monotonic_seconds();
+                play_answer(source);
+            } else if(answering >= 0) {
+                double sound_time = capture[0].start_time + (answering+1)*source[0].interval_frames/rate;
+                run[0].stage_ms[STAGE_PLAYBACK][answering] = 1000.0*(arrival_time - answer_time);
+                run[0].stage_ms[STAGE_ROUND_TRIP][answering] = 1000.0*(found_time - sound_time);
+                run[0].nr_answered++;
+                answering = -1;
+            }
+        }
+        frame_base += hop;
+    }
+
+    free(pcm);
+    free(newest);
+}
+
+static float percentile(const float* sorted, size_t nr, double p) {
+    size_t rank = (size_t) ceil(p*nr);
+    return sorted[(rank > 0) ? rank-1 : 0];
+}
+
+/* the percentiles of every stage; returns the p99 of the round trip, or INFINITY if no answer came back */
+static double report_run(latency_run_t* run, size_t period_frames, double rate) {
+    printf("buffer %5zu frames (%5.2f ms): %zu of %zu impulses found, %zu answers back\n",
+        period_frames, 1000.0*period_frames/rate, run[0].nr_found, run[0].nr_impulses, run[0].nr_answered);
+    printf("    %-12s %8s %8s %8s %8s %8s   (ms)\n", "stage", "p50", "p90", "p99", "max", "jitter");
+    double round_trip_p99 = INFINITY;
+    float* sorted = malloc(run[0].nr_impulses*sizeof(float));
+    for(int s = 0; s < LATENCY_STAGES; s++) {
+        size_t nr = 0;
+        double sum = 0.0, sum2 = 0.0;
+        for(size_t k = 0; k < run[0].nr_impulses; k++) {
+            float ms = run[0].stage_ms[s][k];
+            if(isnan(ms)) continue;
+            sorted[nr++] = ms;
+            sum += ms;
+            sum2 += ms*ms;
+        }
+        if(nr == 0) {
+            printf("    %-12s %8s\n", stage_names[s], "-");
+            continue;
+        }
+        qsort(sorted, nr, sizeof(float), float_cmp_qsort);
+        /* the jitter is the standard deviation */
+        double mean = sum/nr;
+        double jitter = sqrt(fmax(sum2/nr - mean*mean, 0.0));
+        printf("    %-12s %8.2f %8.2f %8.2f %8.2f %8.2f\n", stage_names[s],
+            percentile(sorted, nr, 0.5), percentile(sorted, nr, 0.9), percentile(sorted, nr, 0.99), sorted[nr-1], jitter);
+        if(s == STAGE_ROUND_TRIP) round_trip_p99 = percentile(sorted, nr, 0.99);
+    }
+    free(sorted);
+    return round_trip_p99;
+}
+
+int main(int argc, char** argv) {
+    int rate = 44100;
+    const char* period_list = "64,128,256,512,1024";
+    size_t hop = 512;
+    size_t nr_impulses = 20;
+    double interval = 0.1, budget_ms = 20.0;
+    bool use_loopback = false;
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-L") == 0) {
+            use_loopback = true;
+        } else if(i+1 < argc && strcmp(argv[i], "-r") == 0) {
+            rate = atoi(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-k") == 0) {
+            period_list = argv[++i];
+        } else if(i+1 < argc && strcmp(argv[i], "-s") == 0) {
+            hop = atol(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-i") == 0) {
+            nr_impulses = atol(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-t") == 0) {
+            interval = atof(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-b") == 0) {
+            budget_ms = atof(argv[++i]);
+        } else {
+            die("usage: tty-snd-latency [-L] [-r rate] [-k frames,frames,...] [-s hop] [-i impulses] [-t interval] [-b budget-ms]\n");
+        }
+    }
+    if(hop < 1) die("the hop has to be at least one frame!\n");
+    assert(rate > 0 && nr_impulses > 0 && budget_ms > 0);
+    size_t interval_frames = (size_t) lround(interval*rate);
+    if(interval_frames < 2*hop) die("the impulses have to be at least two hops apart!\n");
+
+    int nr_periods;
+    char** periods = split(period_list, strlen(period_list), ',', &nr_periods);
+    if(use_loopback) aladLoadAL();
+
+    printf("%s source, %i Hz, hop %zu, %zu impulses %.3f s apart\n\n",
+        use_loopback ? "loopback" : "synthetic", rate, hop, nr_impulses, interval);
+    size_t best_period = 0;
+    for(int p = 0; p < nr_periods; p++) {
+        size_t period_frames = atol(periods[p]);
+        if(period_frames < 1) die("a buffer size has to be at least one frame!\n");
+
+        impulse_source_t source = {0};
+        source.period_frames = period_frames;
+        source.interval_frames = interval_frames;
+        source.total_frames = (nr_impulses+1)*interval_frames;
+        source.period_times = calloc(source.total_frames/period_frames + 2, sizeof(double));
+        atomic_init(&source.answer_pending, false);
+        sample_format_t format = {1, true};
+        loopback_t loopback;
+        if(use_loopback) {
+            if(!open_loopback(&loopback, rate, format)) die("no loopback device that renders floats!\n");
+            source.loopback = &loopback;
+            prepare_loopback_impulses(&source, rate);
+        }
+
+        latency_run_t run = {0};
+        run.nr_impulses = nr_impulses;
+        for(int s = 0; s < LATENCY_STAGES; s++) {
+            run.stage_ms[s] = malloc(nr_impulses*sizeof(float));
+            for(size_t k = 0; k < nr_impulses; k++) run.stage_ms[s][k] = NAN;
+        }
+
+        render_source_t render = {render_impulses, impulses_playing, &source, rate, format};
+        capture_t capture;
+        start_rendered_capture(&capture, &render, (double) period_frames/rate, 1.0, true);
+        assert(capture.period_frames == period_frames);
+        detect_impulses(&capture, format, &source, hop, &run);
+        stop_capture(&capture);
+
+        double round_trip_p99 = report_run(&run, period_frames, rate);
+        printf("    round trip p99 %.2f ms, budget %.0f ms%s\n\n", round_trip_p99, budget_ms, (round_trip_p99 > budget_ms) ? " EXCEEDED" : "");
+        if(round_trip_p99 <= budget_ms && period_frames > best_period) best_period = period_frames;
+
+        if(use_loopback) {
+            alDeleteSources(1, &source.answer_source);
+            alDeleteBuffers(1, &source.answer_buffer);
+            close_loopback(&loopback);
+        }
+        for(int s = 0; s < LATENCY_STAGES; s++) free(run.stage_ms[s]);
+        free(source.period_times);
+        free(periods[p]);
+    }
+    free(periods);
+
+    if(best_period > 0) printf("largest buffer within the budget: %zu frames\n", best_period);
+    else printf("no buffer size keeps the round trip within the budget\n");
+
+    if(use_loopback) aladTerminate();
+    return 0;
+}
@@ -41,9 +41,13 @@ typedef FORMANTS_FLOAT sample;
 #define formants_make_root_solver                           NS(make_root_solver)
 #define formants_destroy_root_solver                        NS(destroy_root_solver)
 #define formants_solve_roots                                NS(solve_roots)
+#define formants_seed_work                                  NS(seed_work)
+#define formants_set_warm_start                             NS(set_warm_start)
+#define formants_set_max_iterations                         NS(set_max_iterations)
 #define formants_make_work                                  NS(make_work)
 #define formants_destroy_work                               NS(destroy_work)
 #define formants_analyze                                    NS(analyze)
+#define formants_analyze_into                               NS(analyze_into)
 
 #ifdef __cplusplus
 extern "C" {
@@ -70,9 +74,23 @@ typedef struct lpc_t {
     lpc_work_t *work;
 } lpc_t;
 
+#define FORMANTS_DEFAULT_SEED           0x9E3779B97F4A7C15ULL
+#define FORMANTS_DEFAULT_MAX_ITERATIONS 500
+
+enum {
+    FORMANTS_ROOTS_CONVERGED = 0,
+    FORMANTS_ROOTS_MAX_ITERATIONS = 1,
+};
+
 typedef struct root_solver_t {
     complex_t *roots;
     unsigned long degree;
+    unsigned long long rngState;    /* private generator, so solvers on different threads don't share rand() */
+    unsigned long maxIterations;
+    unsigned long iterations;       /* taken by the last solve */
+    int status;                     /* FORMANTS_ROOTS_CONVERGED or FORMANTS_ROOTS_MAX_ITERATIONS */
+    int warmStart;                  /* start from the roots of the last solve instead of random ones */
+    int hasPrevious;                /* the roots hold a converged solution to start from */
 } root_solver_t;
 
 typedef struct work_t {
@@ -111,7 +129,7 @@ root_solver_t *formants_make_root_solver(unsigned long degree);
 
 void formants_destroy_root_solver(root_solver_t *solver);
 
-void formants_solve_roots(root_solver_t *solver, const sample *coefs, unsigned long degree);
+int formants_solve_roots(root_solver_t *solver, const sample *coefs, unsigned long degree);
 
 libf_formant_t *formants_calculate_from_roots(const complex_t *roots,
                                             unsigned long rootCount,
@@ -119,10 +137,23 @@ libf_formant_t *formants_calculate_from_roots(const complex_t *roots,
                                             sample margin,
                                             unsigned long *formantCount);
 
+void formants_calculate_from_roots_into(const complex_t *roots,
+                                        unsigned long rootCount,
+                                        sample sampleRate,
+                                        sample margin,
+                                        libf_formant_t *formants,
+                                        unsigned long *formantCount);
+
 work_t *formants_make_work(unsigned long length, unsigned long order);
 
 void formants_destroy_work(work_t *work);
 
+void formants_seed_work(work_t *work, unsigned long long seed);
+
+void formants_set_warm_start(work_t *work, int enabled);
+
+void formants_set_max_iterations(work_t *work, unsigned long maxIterations);
+
 libf_formant_t *formants_analyze(work_t *work,
                             const sample *input,
                             unsigned long length,
@@ -131,6 +162,15 @@ libf_formant_t *formants_analyze(work_t *work,
                             sample margin,
                             unsigned long *formantCount);
 
+void formants_analyze_into(work_t *work,
+                           const sample *input,
+                           unsigned long length,
+                           unsigned long order,
+                           sample sampleRate,
+                           sample margin,
+                           libf_formant_t *formants,
+                           unsigned long *formantCount);
+
 void formants_sort(libf_formant_t *formants, unsigned long formantCount);
 
 #ifdef __cplusplus
@@ -276,6 +316,7 @@ void formants_destroy_lpc_work(lpc_work_t *lpcWork)
         free(lpcWork->b2);
         free(lpcWork->aa);
         free(lpcWork->win);
+        free(lpcWork);
     }
 }
 
@@ -296,7 +337,96 @@ void formants_destroy_lpc(lpc_t *lpc)
     if (lpc) {
         free(lpc->data);
         formants_destroy_lpc_work(lpc->work);
+        free(lpc);
+    }
+}
+
+/*
+ * Burg kernels: the sums for the next order are taken in the same pass that updates the
+ * forward and backward errors, with two vector accumulators per sum (GCC vector extensions,
+ * 16 bytes per vector) instead of one serial running sum.
+ */
+#if defined(__GNUC__)
+#define FORMANTS__LANES (16 / sizeof(sample))
+typedef sample formants__vec __attribute__((vector_size(16)));
+typedef sample formants__vec_u __attribute__((vector_size(16), aligned(sizeof(sample))));
+#define FORMANTS__LOAD(p) (*(const formants__vec_u *) (p))
+#define FORMANTS__STORE(p, v) (*(formants__vec_u *) (p) = (v))
+
+static sample formants__hsum(formants__vec v)
+{
+    sample sum = 0.0;
+    for (unsigned long l = 0; l < FORMANTS__LANES; ++l)
+        sum += v[l];
+    return sum;
+}
+#endif
+
+/* num = sum b1[j]*b2[j], denum = sum b1[j]^2 + b2[j]^2 over j < count */
+static void formants__burg_dot(const sample *b1, const sample *b2, unsigned long count, sample *numOut, sample *denumOut)
+{
+    unsigned long j = 0;
+    sample num = 0.0, denum = 0.0;
+#if defined(__GNUC__)
+    formants__vec num0 = {0}, num1 = {0}, den0 = {0}, den1 = {0};
+    for (; j + 2 * FORMANTS__LANES <= count; j += 2 * FORMANTS__LANES) {
+        formants__vec f0 = FORMANTS__LOAD(&b1[j]), f1 = FORMANTS__LOAD(&b1[j + FORMANTS__LANES]);
+        formants__vec g0 = FORMANTS__LOAD(&b2[j]), g1 = FORMANTS__LOAD(&b2[j + FORMANTS__LANES]);
+        num0 += f0 * g0;
+        num1 += f1 * g1;
+        den0 += f0 * f0 + g0 * g0;
+        den1 += f1 * f1 + g1 * g1;
+    }
+    num = formants__hsum(num0 + num1);
+    denum = formants__hsum(den0 + den1);
+#endif
+    for (; j < count; ++j) {
+        num += b1[j] * b2[j];
+        denum += b1[j] * b1[j] + b2[j] * b2[j];
+    }
+    *numOut = num;
+    *denumOut = denum;
+}
+
+/* b1[j] -= k*b2[j], b2[j] = b2[j+1] - k*b1[j+1] (old b1[j+1]) for j < count, fused with
+   formants__burg_dot over the new values; b1 and b2 must be readable up to index count */
+static void formants__burg_update_dot(sample *b1, sample *b2, unsigned long count, sample k, sample *numOut, sample *denumOut)
+{
+    unsigned long j = 0;
+    sample num = 0.0, denum = 0.0;
+#if defined(__GNUC__)
+    formants__vec kk = k - (formants__vec) {0}; /* broadcast */
+    formants__vec num0 = {0}, num1 = {0}, den0 = {0}, den1 = {0};
+    for (; j + 2 * FORMANTS__LANES <= count; j += 2 * FORMANTS__LANES) {
+        /* load everything before storing, b1[j+1..] have to be the old values */
+        formants__vec f0 = FORMANTS__LOAD(&b1[j]), f1 = FORMANTS__LOAD(&b1[j + FORMANTS__LANES]);
+        formants__vec g0 = FORMANTS__LOAD(&b2[j]), g1 = FORMANTS__LOAD(&b2[j + FORMANTS__LANES]);
+        formants__vec fn0 = FORMANTS__LOAD(&b1[j + 1]), fn1 = FORMANTS__LOAD(&b1[j + 1 + FORMANTS__LANES]);
+        formants__vec gn0 = FORMANTS__LOAD(&b2[j + 1]), gn1 = FORMANTS__LOAD(&b2[j + 1 + FORMANTS__LANES]);
+        f0 -= kk * g0;
+        f1 -= kk * g1;
+        g0 = gn0 - kk * fn0;
+        g1 = gn1 - kk * fn1;
+        FORMANTS__STORE(&b1[j], f0);
+        FORMANTS__STORE(&b1[j + FORMANTS__LANES], f1);
+        FORMANTS__STORE(&b2[j], g0);
+        FORMANTS__STORE(&b2[j + FORMANTS__LANES], g1);
+        num0 += f0 * g0;
+        num1 += f1 * g1;
+        den0 += f0 * f0 + g0 * g0;
+        den1 += f1 * f1 + g1 * g1;
+    }
+    num = formants__hsum(num0 + num1);
+    denum = formants__hsum(den0 + den1);
+#endif
+    for (; j < count; ++j) {
+        b1[j] -= k * b2[j];
+        b2[j] = b2[j + 1] - k * b1[j + 1];
+        num += b1[j] * b2[j];
+        denum += b1[j] * b1[j] + b2[j] * b2[j];
     }
+    *numOut = num;
+    *denumOut = denum;
 }
 
 void formants_analyze_lpc(lpc_t *lpc, const sample *input, unsigned long length)
@@ -340,13 +470,10 @@ void formants_analyze_lpc(lpc_t *lpc, const sample *input, unsigned long length)
     for (j = 2; j <= n - 1; ++j)
         b1[j] = b2[j - 1] = x[j];
 
-    for (i = 1; i <= m; ++i) {
-        sample num = 0.0, denum = 0.0;
-        for (j = 1; j <= n - i; ++j) {
-            num += b1[j] * b2[j];
-            denum += b1[j] * b1[j] + b2[j] * b2[j];
-        }
+    sample num, denum;
+    formants__burg_dot(&b1[1], &b2[1], n - 1, &num, &denum);
 
+    for (i = 1; i <= m; ++i) {
         if (denum <= 0.0) {
             xms = 0.0;
             goto end;
@@ -362,10 +489,8 @@ void formants_analyze_lpc(lpc_t *lpc, const sample *input, unsigned long length)
         if (i < m) {
             for (j = 1; j <= i; ++j)
                 aa[j] = a[j];
-            for (j = 1; j <= n - i - 1; ++j) {
-                b1[j] -= aa[i] * b2[j];
-                b2[j] = b2[j + 1] - aa[i] * b1[j + 1];
-            }
+            /* the sums for order i+1 come out of the update */
+            formants__burg_update_dot(&b1[1], &b2[1], n - i - 1, aa[i], &num, &denum);
         }
     }
 
@@ -381,6 +506,12 @@ root_solver_t *formants_make_root_solver(unsigned long degree)
     if (solver) {
         solver->degree = degree;
         solver->roots = (complex_t *) malloc(degree * sizeof(complex_t));
+        solver->rngState = FORMANTS_DEFAULT_SEED;
+        solver->maxIterations = FORMANTS_DEFAULT_MAX_ITERATIONS;
+        solver->iterations = 0;
+        solver->status = FORMANTS_ROOTS_CONVERGED;
+        solver->warmStart = 0;
+        solver->hasPrevious = 0;
     }
     return solver;
 }
@@ -389,15 +520,22 @@ void formants_destroy_root_solver(root_solver_t *solver)
 {
     if (solver) {
         free(solver->roots);
+        free(solver);
     }
 }
 
-static sample formants__rand_float()
+/* xorshift64*, uniform in [-0.5, 0.5) */
+static sample formants__rand_float(unsigned long long *state)
 {
-    return (rand() - RAND_MAX / 2) * (1.0 / ((sample) RAND_MAX));
+    unsigned long long x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return (sample) ((x * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0) - 0.5;
 }
 
-void formants__init_root_solver(complex_t *roots, const sample *coefs, unsigned long degree)
+void formants__init_root_solver(complex_t *roots, const sample *coefs, unsigned long degree, unsigned long long *rngState)
 {
     sample maxUpper = 0.0;
     sample maxLower = 1.0;
@@ -413,8 +551,8 @@ void formants__init_root_solver(complex_t *roots, const sample *coefs, unsigned
     const sample lower = fabs(coefs[degree - 1]) / (fabs(coefs[degree - 1]) + maxLower);
 
     for (unsigned long i = 0; i < degree; ++i) {
-        const sample r = lower + (upper - lower) * formants__rand_float();
-        const sample theta = 2 * libf_PI * formants__rand_float();
+        const sample r = lower + (upper - lower) * formants__rand_float(rngState);
+        const sample theta = 2 * libf_PI * formants__rand_float(rngState);
 
         roots[i] = cplx(r * cos(theta), r * sin(theta));
     }
@@ -431,17 +569,35 @@ void formants__evaluate_monic_polynomial_and_derivative(const sample *coefs, uns
     }
 }
 
-void formants_solve_roots(root_solver_t *solver, const sample *coefs, unsigned long degree)
+static int formants__roots_usable(const complex_t *roots, unsigned long degree)
+{
+    for (unsigned long k = 0; k < degree; ++k) {
+        if (!isfinite(cplx_real(roots[k])) || !isfinite(cplx_imag(roots[k])))
+            return 0;
+        for (unsigned long j = 0; j < k; ++j) {
+            if (cplx_real(roots[k]) == cplx_real(roots[j]) && cplx_imag(roots[k]) == cplx_imag(roots[j]))
+                return 0;
+        }
+    }
+    return 1;
+}
+
+int formants_solve_roots(root_solver_t *solver, const sample *coefs, unsigned long degree)
 {
     assert(degree == solver->degree);
 
-    formants__init_root_solver(solver->roots, coefs, degree);
+    /* Aberth needs distinct starting points, so a warm start is only taken from a
+       converged solution without repeated roots */
+    if (!(solver->warmStart && solver->hasPrevious && formants__roots_usable(solver->roots, degree))) {
+        formants__init_root_solver(solver->roots, coefs, degree, &solver->rngState);
+    }
     unsigned long iteration = 0;
     unsigned long valid, k, j;
 
     complex_t y, dy, ratio, sum, offset;
 
-    while (1) {
+    solver->status = FORMANTS_ROOTS_MAX_ITERATIONS;
+    while (iteration < solver->maxIterations) {
         valid = 0;
         for (k = 0; k < degree; ++k) {
             formants__evaluate_monic_polynomial_and_derivative(coefs, degree, solver->roots[k], &y, &dy);
@@ -464,16 +620,27 @@ void formants_solve_roots(root_solver_t *solver, const sample *coefs, unsigned l
             }
             solver->roots[k] = cplx_sub(solver->roots[k], offset);
         }
+        iteration++;
         if (valid == degree) {
+            solver->status = FORMANTS_ROOTS_CONVERGED;
             break;
         }
-        iteration++;
     }
+    solver->iterations = iteration;
+    solver->hasPrevious = (solver->status == FORMANTS_ROOTS_CONVERGED);
+    return solver->status;
 }
 
 libf_formant_t *formants_calculate_from_roots(const complex_t *roots, unsigned long rootCount, sample sampleRate, sample margin, unsigned long *formantCount)
 {
     libf_formant_t *formants = (libf_formant_t *) malloc((rootCount / 2) * sizeof(libf_formant_t));
+    formants_calculate_from_roots_into(roots, rootCount, sampleRate, margin, formants, formantCount);
+    return formants;
+}
+
+/* formants needs room for rootCount / 2 of them */
+void formants_calculate_from_roots_into(const complex_t *roots, unsigned long rootCount, sample sampleRate, sample margin, libf_formant_t *formants, unsigned long *formantCount)
+{
     unsigned long k = 0;
     for (unsigned long i = 0; i < rootCount; ++i) {
         if (cplx_imag(roots[i]) < 0)
@@ -492,7 +659,6 @@ libf_formant_t *formants_calculate_from_roots(const complex_t *roots, unsigned l
         }
     }
     *formantCount = k;
-    return formants;
 }
 
 work_t *formants_make_work(unsigned long length, unsigned long order)
@@ -512,18 +678,53 @@ void formants_destroy_work(work_t *work)
     if (work) {
         formants_destroy_lpc(work->lpc);
         formants_destroy_root_solver(work->rootSolver);
+        free(work);
     }
 }
 
+/* also forgets the previous roots, so the next analysis starts cold from the new seed */
+void formants_seed_work(work_t *work, unsigned long long seed)
+{
+    /* xorshift must not start at zero */
+    work->rootSolver->rngState = seed ? seed : FORMANTS_DEFAULT_SEED;
+    work->rootSolver->hasPrevious = 0;
+}
+
+/* in frame-by-frame analysis the roots of neighbouring frames are close, so starting from the
+   last ones converges in a few iterations */
+void formants_set_warm_start(work_t *work, int enabled)
+{
+    work->rootSolver->warmStart = enabled;
+}
+
+void formants_set_max_iterations(work_t *work, unsigned long maxIterations)
+{
+    work->rootSolver->maxIterations = maxIterations;
+}
+
 libf_formant_t *formants_analyze(work_t *work, const sample *input, unsigned long length, unsigned long order, sample sampleRate, sample margin, unsigned long *formantCount)
+{
+    libf_formant_t *formants = (libf_formant_t *) malloc((order / 2) * sizeof(libf_formant_t));
+    formants_analyze_into(work, input, length, order, sampleRate, margin, formants, formantCount);
+    return formants;
+}
+
+/* as formants_analyze, into the caller's formants, which needs room for order / 2 of them, so
+   frame-by-frame analysis does not allocate */
+void formants_analyze_into(work_t *work, const sample *input, unsigned long length, unsigned long order, sample sampleRate, sample margin, libf_formant_t *formants, unsigned long *formantCount)
 {
     if (length != work->length || order != work->order) {
         formants_destroy_lpc(work->lpc);
         work->lpc = formants_make_lpc(length, order);
     }
     if (order != work->order) {
+        /* the settings and the generator carry over, the previous roots do not */
+        root_solver_t *solver = formants_make_root_solver(order);
+        solver->rngState = work->rootSolver->rngState;
+        solver->maxIterations = work->rootSolver->maxIterations;
+        solver->warmStart = work->rootSolver->warmStart;
         formants_destroy_root_solver(work->rootSolver);
-        work->rootSolver = formants_make_root_solver(order);
+        work->rootSolver = solver;
     }
     work->length = length;
     work->order = order;
@@ -531,9 +732,8 @@ libf_formant_t *formants_analyze(work_t *work, const sample *input, unsigned lon
     formants_analyze_lpc(work->lpc, input, length);
     formants_solve_roots(work->rootSolver, work->lpc->data, order);
     
-    libf_formant_t *formants = formants_calculate_from_roots(work->rootSolver->roots, work->order, sampleRate, margin, formantCount);
+    formants_calculate_from_roots_into(work->rootSolver->roots, work->order, sampleRate, margin, formants, formantCount);
     formants_sort(formants, *formantCount);
-    return formants;
 }
 
 int formants__compare_frequency(const void *va, const void *vb)
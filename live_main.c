@@ -0,0 +1,443 @@
+#include "common.h"
+#include <unistd.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+
+/* tty-snd-live:
+        record from capture device dev-nr and show its spectrum in the terminal as it comes in:
+        a bar per column over log spaced frequencies, the strongest peaks with their note names
+        and the measured latency. Without arguments, list the capture devices.
+
+        tty-snd-live dev-nr [-r rate] [-c channels] [-f 16|float] [-n fft-length] [-s hop]
+                            [-p period] [-H rows] [-w columns] [-l min-Hz] [-u max-Hz] [-k peaks]
+                            [-b budget-ms]
+
+        -r Hz             capture rate (default 44100)
+        -c, -f            channels and sample format, as for tty-snd-mic-src
+        -n frames         FFT length, a power of two (default 2048)
+        -s frames         hop between two spectra (default 512)
+        -p seconds        how often the capture thread drains the device (default 0.005)
+        -H rows           height of the bars (default 16)
+        -w columns        number of bars (default: the width of the terminal)
+        -l, -u Hz         frequency range of the bars (default 50 to 8000)
+        -k peaks          number of peaks listed (default 5, at most 8)
+        -b ms             latency budget (default 20): if the analysis falls behind by more than
+                          that, hops are skipped so what is shown stays current
+
+        A capture thread fills the ring of capture.c, a processing thread runs a Hann windowed
+        FFT and the peak search of direct_peak.c per hop, and the main thread redraws as soon
+        as a new spectrum is there, at most every 1/60 s. Only the cells that changed since the last refresh are
+        written, so a refresh is a few hundred bytes instead of the whole screen.
+*/
+
+#define LIVE_MAX_PEAKS 8
+#define LIVE_FLOOR_DB -80.0f
+#define LIVE_PEAK_MIN_DB -60.0f
+#define LIVE_MIN_REFRESH (1.0/60.0)
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void on_interrupt(int sig) {
+    interrupted = 1;
+}
+
+typedef struct live_peak_t {
+    float freq;
+    float db;
+} live_peak_t;
+
+/* one analysed hop, as the processing thread hands it to the display */
+typedef struct live_frame_t {
+    size_t frame_nr;
+    uint8_t* levels;        /* per column, in eighths of a row */
+    live_peak_t peaks[LIVE_MAX_PEAKS];
+    int nr_peaks;
+    double ready_time;      /* monotonic_seconds when the analysis was done */
+    double queue_ms;        /* what was still waiting in the ring when the hop was read */
+    double process_ms;
+    size_t skipped_hops;
+} live_frame_t;
+
+typedef struct live_t {
+    capture_t* capture;
+    sample_format_t format;
+    double sample_rate;
+    size_t fft_len, hop;
+    int rows, columns;
+    size_t* column_bins;    /* columns+1 bin boundaries */
+    size_t min_bin, max_bin;
+    int nr_peaks;
+    double budget;          /* seconds */
+
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    live_frame_t latest;    /* under lock */
+    bool finished;          /* under lock */
+} live_t;
+
+/* the nr strongest local maxima above LIVE_PEAK_MIN_DB, strongest first, with parabolic interpolation */
+static int find_live_peaks(const float* db, size_t min_bin, size_t max_bin, double bin_hz, int nr, peak_index_buffer_t* buffer, live_peak_t* peaks) {
+    int found = 0;
+    if(nr < 1) return 0;
+    if(min_bin < 1) min_bin = 1;
+    if(max_bin <= min_bin) return 0;
+
+    /* the bins min_bin to max_bin-1 are the inner samples of the range searched */
+    peak_constraints_t constraints = {LIVE_PEAK_MIN_DB, 0.0, 0};
+    size_t nr_candidates = calculate_peaks(&db[min_bin-1], max_bin - min_bin + 2, &constraints, buffer);
+    for(size_t p = 0; p < nr_candidates; p++) {
+        size_t k = min_bin - 1 + buffer[0].indices[p];
+        if(found == nr && db[k] <= peaks[nr-1].db) continue;
+
+        float a = db[k-1], b = db[k], c = db[k+1];
+        float curvature = a - 2*b + c;
+        float offset = (curvature < 0.0f) ? 0.5f*(a - c)/curvature : 0.0f;
+        live_peak_t peak = {(float)((k + offset)*bin_hz), b - 0.25f*(a - c)*offset};
+
+        int pos = (found < nr) ? found++ : nr-1;
+        while(pos > 0 && peaks[pos-1].db < peak.db) {
+            peaks[pos] = peaks[pos-1];
+            pos--;
+        }
+        peaks[pos] = peak;
+    }
+    return found;
+}
+
+static void* live_process(void* arg) {
+    live_t* live = arg;
+    size_t fft_len = live[0].fft_len;
+    size_t hop = live[0].hop;
+    size_t frame_size = sample_frame_size(live[0].format);
+
+    uint8_t* pcm = malloc(hop*frame_size);
+    float* history = calloc(fft_len, sizeof(float));
+    float* window = malloc(fft_len*sizeof(float));
+    float* spectrum = malloc(2*fft_len*sizeof(float));
+    float* work = malloc(fft_batch_work_size(2*fft_len)*sizeof(float));
+    float* db = malloc((fft_len/2+1)*sizeof(float));
+    uint8_t* levels = malloc(live[0].columns);
+    peak_index_buffer_t peak_buffer = {0};
+    for(size_t i = 0; i < fft_len; i++) {
+        window[i] = 0.5f - 0.5f*cosf(2*M_PI*i/fft_len);
+    }
+    /* a full scale sine under the Hann window has the magnitude fft_len/4 */
+    float scale = 4.0f/fft_len;
+    double bin_hz = live[0].sample_rate/fft_len;
+    size_t skipped = 0;
+
+    while(!interrupted) {
+        size_t got = 0;
+        while(got < hop) {
+            size_t nr = capture_read(live[0].capture, &pcm[got*frame_size], hop - got);
+            if(nr == 0) break;
+            got += nr;
+        }
+        if(got < hop) break;
+        double start = monotonic_seconds();
+        memmove(history, &history[hop], (fft_len-hop)*sizeof(float));
+        frames_to_mono(pcm, hop, live[0].format, &history[fft_len-hop], 1);
+
+        /* more than the budget behind: take the waiting hops into the history without analysing them */
+        size_t backlog = frame_ring_available(&live[0].capture[0].ring);
+        while(backlog >= hop && backlog/live[0].sample_rate > live[0].budget) {
+            size_t nr = frame_ring_read(&live[0].capture[0].ring, pcm, hop);
+            memmove(history, &history[nr], (fft_len-nr)*sizeof(float));
+            frames_to_mono(pcm, nr, live[0].format, &history[fft_len-nr], 1);
+            backlog -= nr;
+            skipped++;
+        }
+
+        for(size_t i = 0; i < fft_len; i++) {
+            spectrum[2*i] = window[i]*history[i];
+            spectrum[2*i+1] = 0.0f;
+        }
+        fft_power_of_two_batch_f(spectrum, spectrum, 2*fft_len, 1, false, work);
+        for(size_t k = 0; k <= fft_len/2; k++) {
+            float power = (spectrum[2*k]*spectrum[2*k] + spectrum[2*k+1]*spectrum[2*k+1])*scale*scale;
+            db[k] = 10.0f*log10f(power + 1e-20f);
+        }
+
+        for(int c = 0; c < live[0].columns; c++) {
+            float max = LIVE_FLOOR_DB;
+            for(size_t k = live[0].column_bins[c]; k < column_bin_end(live[0].column_bins, c); k++) {
+                if(db[k] > max) max = db[k];
+            }
+            long level = lroundf((max - LIVE_FLOOR_DB)/(-LIVE_FLOOR_DB)*live[0].rows*8);
+            levels[c] = (uint8_t)((level > live[0].rows*8) ? live[0].rows*8 : level);
+        }
+        live_peak_t peaks[LIVE_MAX_PEAKS];
+        int nr_peaks = find_live_peaks(db, live[0].min_bin, live[0].max_bin, bin_hz, live[0].nr_peaks, &peak_buffer, peaks);
+        double end = monotonic_seconds();
+
+        pthread_mutex_lock(&live[0].lock);
+        live_frame_t* frame = &live[0].latest;
+        memcpy(frame[0].levels, levels, live[0].columns);
+        memcpy(frame[0].peaks, peaks, nr_peaks*sizeof(live_peak_t));
+        frame[0].nr_peaks = nr_peaks;
+        frame[0].ready_time = end;
+        frame[0].queue_ms = 1000.0*backlog/live[0].sample_rate;
+        frame[0].process_ms = 1000.0*(end - start);
+        frame[0].skipped_hops = skipped;
+        frame[0].frame_nr++;
+        pthread_cond_signal(&live[0].ready);
+        pthread_mutex_unlock(&live[0].lock);
+    }
+
+    pthread_mutex_lock(&live[0].lock);
+    live[0].finished = true;
+    pthread_cond_signal(&live[0].ready);
+    pthread_mutex_unlock(&live[0].lock);
+
+    free(pcm);
+    free(history);
+    free(window);
+    free(spectrum);
+    free(work);
+    free(db);
+    free(levels);
+    destroy_peak_buffer(&peak_buffer);
+    return NULL;
+}
+
+
+
+/* the output of one refresh, written with a single fwrite */
+typedef struct screen_buffer_t {
+    char* data;
+    size_t len, size;
+} screen_buffer_t;
+
+static void screen_append(screen_buffer_t* buf, const char* str) {
+    size_t len = strlen(str);
+    if(buf[0].len + len > buf[0].size) {
+        buf[0].size = 2*(buf[0].len + len);
+        buf[0].data = realloc(buf[0].data, buf[0].size);
+    }
+    memcpy(&buf[0].data[buf[0].len], str, len);
+    buf[0].len += len;
+}
+
+static void screen_move(screen_buffer_t* buf, int row, int column) {
+    char move[32];
+    snprintf(move, sizeof(move), "\x1b[%i;%iH", row+1, column+1);
+    screen_append(buf, move);
+}
+
+/* rewrites a text line, only if it changed */
+static void screen_line(screen_buffer_t* buf, int row, const char* text, char* previous, size_t size) {
+    if(strcmp(text, previous) == 0) return;
+    screen_move(buf, row, 0);
+    screen_append(buf, text);
+    screen_append(buf, "\x1b[K");
+    snprintf(previous, size, "%s", text);
+}
+
+static const char* bar_glyphs[9] = {" ", "▁", "▂", "▃", "▄", "▅", "▆", "▇", "█"};
+
+int main(int argc, char** argv) {
+    int rate = 44100;
+    sample_format_t format = {1, false};
+    size_t fft_len = 2048, hop = 512;
+    double period = 0.005, budget_ms = 20.0;
+    int rows = 16, columns = 0, nr_peaks = 5;
+    double min_hz = 50.0, max_hz = 8000.0;
+    const char* dev_arg = NULL;
+    for(int i = 1; i < argc; i++) {
+        if(i+1 < argc && strcmp(argv[i], "-r") == 0) {
+            rate = atoi(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-c") == 0) {
+            format.channels = atoi(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-f") == 0) {
+            i++;
+            if(strcmp(argv[i], "float") == 0) format.is_float = true;
+            else if(strcmp(argv[i], "16") == 0) format.is_float = false;
+            else die("sample format has to be 16 or float!\n");
+        } else if(i+1 < argc && strcmp(argv[i], "-n") == 0) {
+            fft_len = atol(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-s") == 0) {
+            hop = atol(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-p") == 0) {
+            period = atof(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-H") == 0) {
+            rows = atoi(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-w") == 0) {
+            columns = atoi(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-l") == 0) {
+            min_hz = atof(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-u") == 0) {
+            max_hz = atof(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-k") == 0) {
+            nr_peaks = atoi(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-b") == 0) {
+            budget_ms = atof(argv[++i]);
+        } else if(dev_arg == NULL) {
+            dev_arg = argv[i];
+        } else {
+            die("usage: tty-snd-live [dev-nr] [-r rate] [-c channels] [-f 16|float] [-n fft-length] [-s hop] [-p period] [-H rows] [-w columns] [-l min-Hz] [-u max-Hz] [-k peaks] [-b budget-ms]\n");
+        }
+    }
+    if(!is_power_of_2(fft_len) || hop < 1 || hop > fft_len) die("the FFT length has to be a power of two, and the hop between 1 and that!\n");
+    if(format.channels != 1 && format.channels != 2) die("only 1 or 2 channels can be captured!\n");
+    if(nr_peaks < 0) nr_peaks = 0;
+    if(nr_peaks > LIVE_MAX_PEAKS) nr_peaks = LIVE_MAX_PEAKS;
+    if(rows < 1 || rows > 31) die("the bars can be 1 to 31 rows high!\n");
+    assert(rate > 0 && period > 0 && budget_ms > 0 && min_hz > 0 && max_hz > min_hz);
+    if(max_hz > rate/2.0) max_hz = rate/2.0;
+    if(columns <= 0) {
+        struct winsize size;
+        columns = (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col > 1) ? size.ws_col-1 : 79;
+    }
+
+    aladLoadAL();
+
+    if(dev_arg == NULL) {
+        printf("Available mics:\n");
+        const char* capture_dev_string = alcGetString(NULL, ALC_CAPTURE_DEVICE_SPECIFIER);
+
+        int num;
+        char** devs = split(capture_dev_string, strlen(capture_dev_string), '\0', &num);
+
+        for(int i = 0; i < num; i++) {
+            printf("%i: %s\n", i, devs[i]);
+            free(devs[i]);
+        }
+
+        free(devs);
+
+        const char* default_dev = alcGetString(NULL,ALC_CAPTURE_DEFAULT_DEVICE_SPECIFIER);
+        printf("default: %s\n", default_dev);
+        aladTerminate();
+        return 0;
+    }
+
+    ALCdevice* device = open_capture_device(atoi(dev_arg), rate, &format, rate/2);
+    if(device == NULL) die("no mic found");
+
+    live_t live = {0};
+    live.format = format;
+    live.sample_rate = rate;
+    live.fft_len = fft_len;
+    live.hop = hop;
+    live.rows = rows;
+    live.columns = columns;
+    live.nr_peaks = nr_peaks;
+    live.budget = budget_ms/1000.0;
+    live.latest.levels = calloc(columns, 1);
+
+    /* log spaced columns over the bins from 0 to nyquist */
+    live.column_bins = malloc((columns+1)*sizeof(size_t));
+    log_column_bins(live.column_bins, columns, min_hz, max_hz, (double) rate/fft_len, fft_len/2+1);
+    live.min_bin = live.column_bins[0];
+    live.max_bin = (live.column_bins[columns] < fft_len/2) ? live.column_bins[columns] : fft_len/2;
+
+    pthread_mutex_init(&live.lock, NULL);
+    pthread_cond_init(&live.ready, NULL);
+    signal(SIGINT, on_interrupt);
+    signal(SIGTERM, on_interrupt);
+
+    capture_t capture;
+    start_capture(&capture, device, sample_frame_size(format), rate, period, 1.0);
+    live.capture = &capture;
+    pthread_t processing;
+    if(pthread_create(&processing, NULL, live_process, &live) != 0) die("could not start the processing thread!\n");
+
+    /* clear the screen, hide the cursor and draw the frequency axis once */
+    screen_buffer_t out = {0};
+    screen_append(&out, "\x1b[2J\x1b[?25l");
+    for(int c = 0; c < columns; c += 10) {
+        char label[16];
+        format_frequency(label, sizeof(label), min_hz*pow(max_hz/min_hz, (double) c/columns));
+        screen_move(&out, rows, c);
+        screen_append(&out, "|");
+        screen_append(&out, label);
+    }
+    fwrite(out.data, 1, out.len, stdout);
+    fflush(stdout);
+
+    uint8_t* shown = calloc(rows*columns, 1); /* the cleared screen: all blank */
+    live_frame_t frame = {0};
+    frame.levels = calloc(columns, 1);
+    char peak_line[512] = "", previous_peak_line[512] = "";
+    char latency_line[256] = "", previous_latency_line[256] = "";
+    double draw_ms = 0.0, display_ms = 0.0;
+    size_t shown_nr = 0;
+
+    while(!interrupted) {
+        pthread_mutex_lock(&live.lock);
+        while(live.latest.frame_nr == shown_nr && !live.finished && !interrupted) {
+            pthread_cond_wait(&live.ready, &live.lock);
+        }
+        bool finished = live.finished;
+        uint8_t* levels = frame.levels;
+        frame = live.latest;
+        frame.levels = levels;
+        memcpy(frame.levels, live.latest.levels, columns);
+        pthread_mutex_unlock(&live.lock);
+        if(finished || interrupted) break;
+        shown_nr = frame.frame_nr;
+
+        double start = monotonic_seconds();
+        out.len = 0;
+        int cursor_row = -1, cursor_column = -1;
+        for(int r = 0; r < rows; r++) {
+            int base = (rows-1-r)*8;
+            for(int c = 0; c < columns; c++) {
+                int fill = frame.levels[c] - base;
+                fill = (fill < 0) ? 0 : (fill > 8) ? 8 : fill;
+                if(shown[r*columns+c] == fill) continue;
+                shown[r*columns+c] = fill;
+                if(r != cursor_row || c != cursor_column) screen_move(&out, r, c);
+                screen_append(&out, bar_glyphs[fill]);
+                cursor_row = r;
+                cursor_column = c+1;
+            }
+        }
+
+        int len = 0;
+        for(int i = 0; i < frame.nr_peaks; i++) {
+            char* name = note_name(hz_to_octave(frame.peaks[i].freq), NULL, NULL, NULL);
+            len += snprintf(&peak_line[len], sizeof(peak_line)-len, "%7.1f Hz %s %4.0f dB  ", frame.peaks[i].freq, (name != NULL) ? name : "        ", frame.peaks[i].db);
+            free(name);
+            if(len >= sizeof(peak_line)) break;
+        }
+        if(frame.nr_peaks == 0) snprintf(peak_line, sizeof(peak_line), "no peaks");
+        screen_line(&out, rows+2, peak_line, previous_peak_line, sizeof(previous_peak_line));
+
+        /* the newest sample was at most a capture period old when it came out of the device */
+        double total_ms = 1000.0*period + frame.queue_ms + frame.process_ms + display_ms;
+        snprintf(latency_line, sizeof(latency_line), "latency %5.1f ms (capture %.1f + queue %4.1f + analysis %4.1f + display %4.1f), drawing %4.1f ms, budget %.0f ms%s, %zu hops skipped",
+            total_ms, 1000.0*period, frame.queue_ms, frame.process_ms, display_ms, draw_ms, budget_ms, (total_ms > budget_ms) ? " EXCEEDED" : "", frame.skipped_hops);
+        screen_line(&out, rows+3, latency_line, previous_latency_line, sizeof(previous_latency_line));
+
+        fwrite(out.data, 1, out.len, stdout);
+        fflush(stdout);
+        double end = monotonic_seconds();
+        draw_ms = 1000.0*(end - start);
+        display_ms = 1000.0*(end - frame.ready_time);
+
+        double rest = LIVE_MIN_REFRESH - (end - start);
+        if(rest > 0) usleep((useconds_t)(rest*1000000.0));
+    }
+
+    /* the processing thread stops after its current hop, it still needs the ring until then */
+    interrupted = 1;
+    pthread_join(processing, NULL);
+    stop_capture(&capture);
+
+    /* the cursor back, below the display */
+    printf("\x1b[?25h\x1b[%i;1H\n", rows+5);
+    fflush(stdout);
+
+    pthread_mutex_destroy(&live.lock);
+    pthread_cond_destroy(&live.ready);
+    free(shown);
+    free(frame.levels);
+    free(out.data);
+    free(live.latest.levels);
+    free(live.column_bins);
+    alcCaptureCloseDevice(device);
+    aladTerminate();
+
+    return 0;
+}
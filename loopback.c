@@ -0,0 +1,112 @@
+#include "common.h"
+
+/*
+ * OpenAL Soft's ALC_SOFT_loopback: a playback device without hardware behind it, whose mix
+ * the program renders itself with alcRenderSamplesSOFT, as fast as it likes. tty-snd-play -L
+ * renders what it plays into a stream instead of onto a sound card, and tty-snd-mic-src -L
+ * plays a stream on a loopback device and captures the rendered mix. Both run faster than
+ * realtime and produce the same samples on every run, so the capture, analysis and playback
+ * path can be benchmarked and checked on machines without audio hardware.
+ *
+ * The loopback context is made current, so the source and buffer calls of the tools go to it.
+ */
+
+bool open_loopback(loopback_t* loopback, int rate, sample_format_t format) {
+    memset(loopback, 0, sizeof(loopback_t));
+    if(!alcIsExtensionPresent(NULL, "ALC_SOFT_loopback")) {
+        fprintf(stderr, "the OpenAL implementation has no ALC_SOFT_loopback!\n");
+        return false;
+    }
+    /* aladLoadAL only loads the core, the loopback functions are extensions */
+    aladUpdateALCPointersFromDevice(NULL, AL_TRUE);
+    if(alcLoopbackOpenDeviceSOFT == NULL || alcIsRenderFormatSupportedSOFT == NULL || alcRenderSamplesSOFT == NULL) {
+        fprintf(stderr, "could not load the ALC_SOFT_loopback functions!\n");
+        return false;
+    }
+
+    ALCdevice* device = alcLoopbackOpenDeviceSOFT(NULL);
+    if(device == NULL) return false;
+    ALCenum channels = (format.channels == 1) ? ALC_MONO_SOFT : ALC_STEREO_SOFT;
+    ALCenum type = format.is_float ? ALC_FLOAT_SOFT : ALC_SHORT_SOFT;
+    if(!alcIsRenderFormatSupportedSOFT(device, rate, channels, type)) {
+        fprintf(stderr, "the loopback device can not render %i Hz in this format!\n", rate);
+        alcCloseDevice(device);
+        return false;
+    }
+
+    ALCint attributes[] = {
+        ALC_FORMAT_CHANNELS_SOFT, channels,
+        ALC_FORMAT_TYPE_SOFT, type,
+        ALC_FREQUENCY, rate,
+        0
+    };
+    ALCcontext* context = alcCreateContext(device, attributes);
+    if(context == NULL || !alcMakeContextCurrent(context)) {
+        if(context != NULL) alcDestroyContext(context);
+        alcCloseDevice(device);
+        return false;
+    }
+
+    loopback[0].device = device;
+    loopback[0].context = context;
+    loopback[0].rate = rate;
+    loopback[0].format = format;
+    return true;
+}
+
+void close_loopback(loopback_t* loopback) {
+    if(loopback[0].source != 0) {
+        alSourceStop(loopback[0].source);
+        alDeleteSources(1, &loopback[0].source);
+        alDeleteBuffers(1, &loopback[0].buffer);
+    }
+    alcMakeContextCurrent(NULL);
+    alcDestroyContext(loopback[0].context);
+    alcCloseDevice(loopback[0].device);
+    memset(loopback, 0, sizeof(loopback_t));
+}
+
+/* the next nr_frames of the mix, in the format the loopback was opened with */
+void loopback_render(loopback_t* loopback, void* frames, size_t nr_frames) {
+    alcRenderSamplesSOFT(loopback[0].device, frames, (ALCsizei) nr_frames);
+}
+
+/* plays the real parts of wav on a source of the loopback; the source resamples it to the loopback
+   rate. Streams louder than full scale 1 (tty-snd-wav keeps the 16 bit range) are scaled down to it */
+void loopback_play_stream(loopback_t* loopback, const simple_wav_t* wav) {
+    assert(loopback[0].source == 0);
+    alGetError();
+    size_t len = wav[0].nr_sample_points/2;
+    float max = 0.0f;
+    for(size_t i = 0; i < len; i++) {
+        if(fabsf(wav[0].samples[2*i]) > max) max = fabsf(wav[0].samples[2*i]);
+    }
+    float gain = (max > 1.0f) ? 1.0f/max : 1.0f;
+    bool use_float = alIsExtensionPresent("AL_EXT_FLOAT32");
+    sample_format_t format = {1, use_float};
+    void* data = malloc(len*sample_frame_size(format));
+    if(data == NULL) die("out of memory for the loopback stream!\n");
+    if(use_float) {
+        float* samples = data;
+        for(size_t i = 0; i < len; i++) samples[i] = gain*wav[0].samples[2*i];
+    } else {
+        int16_t* samples = data;
+        for(size_t i = 0; i < len; i++) samples[i] = (int16_t) floorf(clamp(gain*wav[0].samples[2*i], -1.0f, 1.0f)*INT16_MAX);
+    }
+
+    alGenBuffers(1, &loopback[0].buffer);
+    alBufferData(loopback[0].buffer, al_sample_format(format), data, len*sample_frame_size(format), (ALsizei) floor(wav[0].frequency_in_hz));
+    free(data);
+    alGenSources(1, &loopback[0].source);
+    alSourcei(loopback[0].source, AL_BUFFER, loopback[0].buffer);
+    alSourcePlay(loopback[0].source);
+    if(alGetError() != AL_NO_ERROR) die("could not play the stream on the loopback device!\n");
+}
+
+/* true as long as the stream of loopback_play_stream has not played out */
+bool loopback_playing(loopback_t* loopback) {
+    if(loopback[0].source == 0) return false;
+    ALint state;
+    alGetSourcei(loopback[0].source, AL_SOURCE_STATE, &state);
+    return state == AL_PLAYING;
+}
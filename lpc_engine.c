@@ -0,0 +1,138 @@
+#include "common.h"
+
+/*
+ * One entry point for all the LPC implementations in the project.
+ *
+ * The engine owns a scratch buffer sized once for the largest order and frame length, so
+ * analysing frame after frame does not allocate. Whatever the method, the result is the
+ * prediction error filter
+ *
+ *      A(z) = 1 + coeffs[1] z^-1 + ... + coeffs[order] z^-order,   coeffs[0] = 1
+ *
+ * which is what informant_algs.c, marple-alg_2.c and lpc.c already compute internally; only
+ * the indexing and the leading 1 differed. &coeffs[1] can be handed to libformants'
+ * formants_solve_roots as is, and lpc_engine_root_polynomial() gives the ascending form
+ * z^order A(z) that poly_complex_solve in root.c expects.
+ */
+
+static size_t work_size_for(int max_order, size_t max_length) {
+    size_t size = autocorr_work_size(max_order);
+    size_t covar = covar_work_size(max_order);
+    size_t burg = burg_work_size(max_order, max_length);
+    size_t marple = ar_params_work_size(max_order);
+    size_t rosa = lpc_rosa_work_size(max_length, max_order);
+    if(covar > size) size = covar;
+    if(burg > size) size = burg;
+    if(marple > size) size = marple;
+    if(rosa > size) size = rosa;
+    return size;
+}
+
+lpc_engine_t create_lpc_engine(lpc_method_t method, int max_order, size_t max_length) {
+    assert(max_order > 0 && max_length > (size_t) max_order);
+    lpc_engine_t engine = {0};
+    engine.method = method;
+    engine.max_order = max_order;
+    engine.max_length = max_length;
+    engine.coeffs = calloc(max_order+1, sizeof(double));
+    engine.work_size = work_size_for(max_order, max_length);
+    engine.work = calloc(engine.work_size, sizeof(double));
+    if(engine.coeffs == NULL || engine.work == NULL) die("out of memory for lpc engine!\n");
+    return engine;
+}
+
+void destroy_lpc_engine(lpc_engine_t* engine) {
+    free(engine[0].coeffs);
+    free(engine[0].work);
+    engine[0].coeffs = NULL;
+    engine[0].work = NULL;
+}
+
+const char* lpc_method_name(lpc_method_t method) {
+    switch(method) {
+        case LPC_AUTOCORRELATION: return "autocorrelation";
+        case LPC_COVARIANCE:      return "covariance";
+        case LPC_BURG:            return "burg";
+        case LPC_MARPLE:          return "marple";
+        case LPC_ROSA:            return "rosa";
+    }
+    return "unknown";
+}
+
+/* the method of a lpc_method_name; false if there is none of that name */
+bool lpc_method_from_name(const char* name, lpc_method_t* method_out) {
+    for(int m = LPC_AUTOCORRELATION; m <= LPC_ROSA; m++) {
+        if(strcmp(name, lpc_method_name(m)) == 0) {
+            method_out[0] = m;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* energy of the prediction error, for methods that do not report it themselves */
+static double prediction_error_energy(const double* data, size_t len, const double* coeffs, int order) {
+    double energy = 0.0;
+    for(size_t i = order; i < len; i++) {
+        double e = data[i];
+        for(int k = 1; k <= order; k++) {
+            e += coeffs[k]*data[i-k];
+        }
+        energy += e*e;
+    }
+    return energy;
+}
+
+static int analyze_marple(lpc_engine_t* engine, const double* data, size_t len, int order) {
+    int m;
+    double e, e0;
+    engine[0].status = ar_params_into(data, len, order, engine[0].marple_tol1, engine[0].marple_tol2, &m, &engine[0].coeffs[1], &e, &e0, engine[0].work);
+    /* e is the forward plus the backward error, twice what the other methods report */
+    engine[0].gain = prediction_error_energy(data, len, engine[0].coeffs, m);
+    return m;
+}
+
+/* returns the order reached, which can be lower than requested if the recursion broke off */
+int lpc_engine_analyze(lpc_engine_t* engine, const double* data, size_t len, int order) {
+    assert(order > 0 && order <= engine[0].max_order);
+    assert(len <= engine[0].max_length && len > (size_t) order);
+
+    double* coeffs = engine[0].coeffs;
+    memset(coeffs, 0, (engine[0].max_order+1)*sizeof(double));
+    engine[0].status = 0;
+    engine[0].gain = 0.0;
+
+    int reached = 0;
+    switch(engine[0].method) {
+        case LPC_AUTOCORRELATION:
+            reached = autocorr_solve_into(data, len, order, &coeffs[1], &engine[0].gain, engine[0].work);
+            break;
+        case LPC_COVARIANCE:
+            reached = Covar_solve_into(data, len, order, &coeffs[1], &engine[0].gain, engine[0].work);
+            break;
+        case LPC_BURG:
+            reached = Burg_solve_into(data, len, order, &coeffs[1], &engine[0].gain, engine[0].work);
+            break;
+        case LPC_MARPLE:
+            reached = analyze_marple(engine, data, len, order);
+            break;
+        case LPC_ROSA:
+            lpc_coefficients_rosa_into_d(data, len, order, coeffs, engine[0].work);
+            reached = order;
+            engine[0].gain = prediction_error_energy(data, len, coeffs, order);
+            break;
+    }
+    /* anything above the reached order is left over from the recursion, not part of A(z) */
+    for(int k = reached+1; k <= order; k++) coeffs[k] = 0.0;
+    coeffs[0] = 1.0;
+    engine[0].order = reached;
+    return reached;
+}
+
+/* ascending coefficients of z^order A(z) for poly_complex_solve, order+1 terms */
+void lpc_engine_root_polynomial(const lpc_engine_t* engine, double* ascending_out) {
+    int p = engine[0].order;
+    for(int k = 0; k <= p; k++) {
+        ascending_out[k] = engine[0].coeffs[p-k];
+    }
+}
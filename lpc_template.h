@@ -0,0 +1,192 @@
+/* lpc.c, instantiated once per precision: REAL is the sample type, MATRIX the matching matrix
+   type, REAL_EPSILON its machine epsilon and RNS(name) the suffixed name */
+
+/*
+ * Burg's method as in librosa.lpc, with the forward and backward prediction errors kept in
+ * work; ar_coeffs_out needs order+1 values, work lpc_rosa_work_size(len, order) values.
+ * ar_coeffs_out[0] will be 1.
+ */
+void RNS(lpc_coefficients_rosa_into)(const REAL* data, size_t len, int order, REAL* ar_coeffs_out, REAL* work) {
+    assert(order > 0 && len > order);
+
+    REAL* ar_coeffs = ar_coeffs_out;
+    memset(ar_coeffs, 0, (order+1)*sizeof(REAL));
+    ar_coeffs[0] = 1;
+    REAL* ar_coeffs_old = work;
+    REAL* fwd = &work[order+1];
+    REAL* bwd = &work[order+1+len];
+
+    /* fwd[k] starts as data[k+1], bwd[k] as data[k]; both shrink by one every order */
+    REAL den = 0.0;
+    for(int i = 0; i < len-1; i++) {
+        assert(isfinite(data[i]) && isfinite(data[i+1]));
+        fwd[i] = data[i+1];
+        bwd[i] = data[i];
+        den += data[i]*data[i] + data[i+1]*data[i+1];
+    }
+    size_t nr_errors = len-1;
+
+    for(int i = 0; i < order; i++) {
+        REAL rc0 = 0.0;
+        for(int k = 0; k < nr_errors; k++) {
+            rc0 += bwd[k]*fwd[k];
+        }
+        rc0 *= (-2) / (den + REAL_EPSILON);
+
+        memmove(ar_coeffs_old, ar_coeffs, (order+1)* sizeof(REAL));
+        for(int j = 1; j < i+2; j++) {
+            ar_coeffs[j] = ar_coeffs_old[j] + rc0*ar_coeffs_old[i - j + 1];
+        }
+
+        for(int k = 0; k < nr_errors; k++) {
+            REAL fwd_old = fwd[k];
+            fwd[k] += rc0*bwd[k];
+            bwd[k] += rc0*fwd_old;
+        }
+        den *= (1.0 - rc0*rc0);
+        den -= bwd[nr_errors-1]*bwd[nr_errors-1] + fwd[0]*fwd[0];
+
+        /* drop the first forward and the last backward error */
+        memmove(fwd, &fwd[1], (nr_errors-1)*sizeof(REAL));
+        nr_errors--;
+    }
+}
+
+REAL* RNS(lpc_coefficients_rosa)(const REAL* data, size_t len, int order) {
+    REAL* ar_coeffs = calloc(order+1, sizeof(REAL));
+    REAL* work = calloc(lpc_rosa_work_size(len, order), sizeof(REAL));
+    RNS(lpc_coefficients_rosa_into)(data, len, order, ar_coeffs, work);
+    free(work);
+    return ar_coeffs;
+}
+
+
+
+/*
+ * Levinson-Durbin recursion: solves the Toeplitz normal equations of the autocorrelation
+ * method in O(order^2) from r[0..order].
+ * a gets the order+1 coefficients of A(z) (a[0] = 1), reflection_out (if not NULL) the order
+ * reflection coefficients; returns the prediction error of the reached order. If the error
+ * stops being positive the recursion ends there and the remaining coefficients stay 0.
+ */
+REAL RNS(levinson_durbin)(const REAL* r, int order, REAL* a, REAL* reflection_out) {
+    assert(order > 0);
+    memset(a, 0, (order+1)*sizeof(REAL));
+    if(reflection_out != NULL) memset(reflection_out, 0, order*sizeof(REAL));
+    a[0] = 1.0;
+
+    REAL err = r[0];
+    for(int i = 1; i <= order; i++) {
+        if(err <= 0.0) break;
+
+        REAL acc = r[i];
+        for(int j = 1; j < i; j++) {
+            acc += a[j]*r[i-j];
+        }
+        REAL k = -acc / err;
+
+        /* a[j] and a[i-j] update each other, so do them in pairs instead of copying */
+        for(int j = 1; j <= i/2; j++) {
+            REAL tmp = a[j];
+            a[j] += k*a[i-j];
+            if(j != i-j) a[i-j] += k*tmp;
+        }
+        a[i] = k;
+        if(reflection_out != NULL) reflection_out[i-1] = k;
+
+        err *= (1.0 - k*k);
+    }
+    return err;
+}
+
+
+
+/*
+ * The LPC envelope without root solving: with A(z) = a[0] + a[1] z^-1 + ... + a[order] z^-order,
+ * the envelope is 1/|A(e^(2 pi i x))|, and its maxima are the formants.
+ */
+
+/* lpc_vector holds a[0..order] in its data (a row or a column vector), x is in cycles per sample */
+REAL RNS(lpc_pole_function)(MATRIX lpc_vector, REAL x) {
+    int len = lpc_vector.width*lpc_vector.height;
+    double re = 0.0, im = 0.0;
+    for(int k = 0; k < len; k++) {
+        re += lpc_vector.data[k]*cos(2*M_PI*x*k);
+        im -= lpc_vector.data[k]*sin(2*M_PI*x*k);
+    }
+    return 1.0/sqrt(re*re + im*im);
+}
+
+/* distance in bins from the peak at which the envelope has fallen by 3 dB, walking in direction
+   dir until the envelope starts rising again; 0 if it does not fall that far */
+static double RNS(envelope_3db_distance)(const REAL* env_db, size_t nr_points, size_t peak, double peak_db, int dir) {
+    double target = peak_db - 3.0;
+    size_t j = peak;
+    while(true) {
+        if((dir < 0 && j == 0) || (dir > 0 && j+1 >= nr_points)) return 0.0;
+        size_t next = j + dir;
+        if(env_db[next] > env_db[j]) return 0.0; /* valley before the 3 dB point */
+        if(env_db[next] <= target) {
+            double frac = (env_db[j] - target)/(env_db[j] - env_db[next]);
+            return fabs((double) j - (double) peak) + frac;
+        }
+        j = next;
+    }
+}
+
+/*
+ * Formants from the envelope of A(z): coeffs are a[0..order], nr_bins the (power of two) length
+ * of the zero padded FFT; the frequency resolution is frequency/nr_bins before interpolation.
+ * Peaks are located by parabolic interpolation on the dB envelope and their 3 dB bandwidths
+ * measured on it; where a neighbouring formant keeps the envelope from falling 3 dB on either
+ * side, the bandwidth comes from the curvature of the parabola instead.
+ * Writes at most max_formants frequencies and bandwidths (in Hz, ascending) and returns how many;
+ * work holds lpc_envelope_work_size(nr_bins) values, so nothing is allocated per frame.
+ */
+size_t RNS(lpc_envelope_formants)(const REAL* coeffs, int order, double frequency, size_t nr_bins, REAL* formants_out, REAL* bws_out, size_t max_formants, REAL* work) {
+    assert(is_power_of_2(nr_bins) && nr_bins > 2*(size_t) order);
+
+    REAL* spectrum = work;
+    REAL* fft_work = &work[2*nr_bins];
+    REAL* env_db = &fft_work[fft_batch_work_size(2*nr_bins)];
+    memset(spectrum, 0, 2*nr_bins*sizeof(REAL));
+    for(int k = 0; k <= order; k++) {
+        spectrum[2*k] = coeffs[k];
+    }
+    RNS(fft_power_of_two_batch)(spectrum, spectrum, 2*nr_bins, 1, false, fft_work);
+
+    /* the envelope is symmetric, only 0 to nyquist matters */
+    size_t nr_points = nr_bins/2 + 1;
+    for(size_t k = 0; k < nr_points; k++) {
+        double power = (double) spectrum[2*k]*spectrum[2*k] + (double) spectrum[2*k+1]*spectrum[2*k+1];
+        env_db[k] = -10.0*log10(power + 1e-30);
+    }
+
+    double bin_hz = frequency/nr_bins;
+    size_t nr_found = 0;
+    for(size_t k = 1; k+1 < nr_points && nr_found < max_formants; k++) {
+        double a = env_db[k-1], b = env_db[k], c = env_db[k+1];
+        if(!(b > a && b >= c)) continue;
+
+        double curvature = a - 2*b + c; /* < 0 at a maximum */
+        double offset = (curvature < 0.0) ? 0.5*(a - c)/curvature : 0.0;
+        double peak_db = b - 0.25*(a - c)*offset;
+
+        double left = RNS(envelope_3db_distance)(env_db, nr_points, k, peak_db, -1);
+        double right = RNS(envelope_3db_distance)(env_db, nr_points, k, peak_db, +1);
+        double bw_bins;
+        if(left > 0.0 && right > 0.0) {
+            bw_bins = left + right;
+        } else if(left > 0.0 || right > 0.0) {
+            bw_bins = 2*((left > 0.0) ? left + offset : right - offset); /* measured from the interpolated peak */
+        } else {
+            bw_bins = (curvature < 0.0) ? 2*sqrt(-6.0/curvature) : NAN;
+        }
+
+        formants_out[nr_found] = (k + offset)*bin_hz;
+        bws_out[nr_found] = bw_bins*bin_hz;
+        nr_found++;
+    }
+
+    return nr_found;
+}
@@ -1,4 +1,3 @@
-#include <complex.h>
 #include "common.h"
 
 /* based on the code in the paper: IEEE TRANSACTIONS ON ACOUSTICS,SPEECH, AND SIGNAL PROCESSING, VOL. ASSP-28, NO. 4, AUGUST 1980
@@ -6,210 +5,211 @@ A New Autoregressive Spectrum Analysis
 Algorithm
 LARRY MARPLE */
 
-#define MAX_NUMBER_POSSIBLE_FOR_MMAX 100
-
-typedef enum ar_status_t {
-    SUCCESS = 0,
-    DEN_ILL_CONDITIONED = 1,
-    A_ILL_CONDITIONED = 2,
-    TOL1_ERROR = 3,
-    TOL2_ERROR = 4,
-} ar_status_t;
+/*
+ * Marple's recursion for the forward-backward least squares AR fit, specialized to real data:
+ * every conjugate of the paper's listing drops out and the complex products become real ones.
+ * Each order costs O(n + m) instead of re-solving the normal equations:
+ *
+ *  - a is the predictor of the current order m, e its forward plus backward error energy,
+ *  - c and d are the inverse of the normal matrix applied to the two data edge vectors
+ *    [x(m+1) ... x(1)] and [x(n-m) ... x(n)], g, w and h their quadratic forms; the matrix is
+ *    persymmetric, so the edge vectors that enter from the other side are just c and d reversed,
+ *  - r holds the last column of the next order's normal matrix, updated from order to order
+ *    by removing the edge products.
+ *
+ * A step first removes the two edge rows from the order m fit (a rank two update through c
+ * and d, the "time update"), then extends the result by one coefficient as in Levinson.
+ *
+ * The comments give the indices of the paper (1-based).
+ */
+
+size_t ar_params_work_size(int mmax) {
+    return 3*(size_t)(mmax+1); /* c, d, r */
+}
 
-int ar_params (double *x_in /* data */,
+/* a gets mmax coefficients: A(z) = 1 + a[0] z^-1 + ... + a[m-1] z^-m, m = out_m[0] is the order reached.
+   work needs ar_params_work_size(mmax) doubles */
+ar_status_t ar_params_into(const double* x /* data */,
      int n /* num_values */,
-     int mmax /* nr_formants */,
-     float tol1, float tol2 /* tolerances */,
+     int mmax /* maximum order */,
+     double tol1, double tol2 /* tolerances */,
      int* out_m /* out_calculated */,
-     double *a_in /* out_ar_params, has to have nr_formants space */,
-     float *out_e /* out_pred_error_energy_order_m */,
-     float *out_e0 /* out_twice_total_energy */
+     double* a /* out_ar_params, has to have mmax space */,
+     double* out_e /* out_pred_error_energy_order_m */,
+     double* out_e0 /* out_twice_total_energy */,
+     double* work
      )
 {
-    complex double *x = (complex double *) x_in; /* data */
-    complex double *a = (complex double *) a_in; /* out_ar_params, has to have nr_formants space */
-
-    int m; float e, e0;
+    assert(mmax > 0 && n > mmax+1);
+    double* c = work;
+    double* d = &work[mmax+1];
+    double* r = &work[2*(mmax+1)];
     ar_status_t status;
 
-    complex double q2, q3, f, b, h, s, u, v, c[MAX_NUMBER_POSSIBLE_FOR_MMAX+1], d[MAX_NUMBER_POSSIBLE_FOR_MMAX+1], r[MAX_NUMBER_POSSIBLE_FOR_MMAX+1], save1, save2, save3, save4, delta, c1, c2, c3, c4, c5, c6;
-    float q1, q4, q5, q6, g, w, den, eold, q7, y1, y2, y3, y4, alpha;
-    int nm, m1, k1, nk, m2, mk;
-
-    /* initialization */
-    e0 = 0;
+    double e0 = 0.0;
     for(int k = 0; k < n; k++) {
-        e0 += cabs(x[k]);
+        e0 += x[k]*x[k];
     }
     e0 *= 2.0;
-    q1 = 1.0/e0;
-    q2 = q1*conj(x[1]);
-    g = q1*cabs(x[0]);
-    w = q1*cabs(x[n-1]);
-    den = 1.0 - g - w;
-    q4 = 1.0 / den;
-    q5 = 1.0 - g;
-    q6 = 1.0 - w;
-    f = x[0];
-    b = x[n-1];
-    h = q2*conj(x[n-1]);
-    s = q2*x[n-1];
-    u = q1*x[n-1]*x[n-1];
-    h = q2*conj(x[0]);
-    e = e0*den;
-    q1 = 1.0 / e;
-    c[0] = q1*conj(x[0]);
+
+    /* order 0: the scalars of the edge vectors [x(1)] and [x(n)] */
+    double q1 = 1.0/e0;
+    double q2 = q1*x[0];
+    double g = q1*x[0]*x[0];
+    double w = q1*x[n-1]*x[n-1];
+    double den = 1.0 - g - w;
+    double q4 = 1.0/den;
+    double q5 = 1.0 - g;
+    double q6 = 1.0 - w;
+    double h = q2*x[n-1];
+    double s = q2*x[n-1];
+    double u = q1*x[n-1]*x[n-1];
+    double v = q2*x[0];
+    double e = e0*den;
+    q1 = 1.0/e;
+    c[0] = q1*x[0];
     d[0] = q1*x[n-1];
-    m = 1;
-    save1 = 0.0;
-    nm = n-1;
-    for(int k = 0; k < nm; k++) {
-        save1 += x[k+1]*conj(x[k]);
+
+    /* order 1 */
+    int m = 1;
+    double save = 0.0;
+    for(int k = 0; k < n-1; k++) {
+        save += x[k+1]*x[k];
     }
-    r[0] = 2.0*save1;
+    r[0] = 2.0*save;
     a[0] = -q1*r[0];
-    e *= 1.0 - cabs(a[0]);
-
-
+    e *= 1.0 - a[0]*a[0];
 
     while(true) {
-
         if(m >= mmax) {
-            status = SUCCESS;
-            goto end;
+            status = AR_SUCCESS;
+            break;
         }
 
-        /* prediction error filter update */
-
-        eold = e;
-        m1 = m+1;
-        f = x[m1-1];
-        b = x[nm-1];
-        for(int k = 0; k < m; k++) {
-            f += x[m1-k]*a[k];
-            b += x[nm+k]*conj(a[k]);
+        /* prediction error filter update: errors at the two edges, F at x(m+1), B at x(n-m) */
+        double eold = e;
+        double f = x[m];
+        double b = x[n-m-1];
+        for(int k = 1; k <= m; k++) {
+            f += x[m-k]*a[k-1];     /* X(M1-K)*A(K) */
+            b += x[n-m-1+k]*a[k-1]; /* X(NM+K)*A(K) */
         }
 
         /* auxiliary vectors order update */
-        q1 = 1.0 / e;
-        q2 = q1*conj(f);
-        q3 = q1*b;
-        for(int k = m-1; k >= 0; k--) {
-            k1 = k+1;
-            c[k1] = c[k]+q2*a[k];
-            d[k1] = d[k]+q3*a[k];
+        q1 = 1.0/e;
+        q2 = q1*f;
+        double q3 = q1*b;
+        for(int k = m; k >= 1; k--) {
+            c[k] = c[k-1] + q2*a[k-1];
+            d[k] = d[k-1] + q3*a[k-1];
         }
         c[0] = q2;
         d[0] = q3;
 
         /* scalar order update */
-
-        q7 = cabs(s);
-        y1 = cabs(f);
-        y3 = cabs(b);
-        y2 = cabs(v);
-        y4 = cabs(u);
-        g += y1*q1+q4*(y2*q6+q7*q5+2.0*creal(conj(v)*h*s));
-        w += y3*q1+q4*(y4*q5+q7*q6+2.0*creal(conj(s)*h*v));
+        double q7 = s*s;
+        double y1 = f*f;
+        double y2 = v*v;
+        double y3 = b*b;
+        double y4 = u*u;
+        g += y1*q1 + q4*(y2*q6 + q7*q5 + 2.0*v*h*s);
+        w += y3*q1 + q4*(y4*q5 + q7*q6 + 2.0*s*h*u);
         h = s = u = v = 0.0;
-        for(int k = -1; k < m; k++) {
-            k1 = k+1;
-            nk = n-k;
-            h += conj(x[nm+k])*c[k1];
-            s += x[nk]*c[k1];
-            u += x[nk]*d[k1];
-            v += conj(x[k1])*c[k1];
+        for(int k = 0; k <= m; k++) {
+            h += x[n-m-1+k]*c[k]; /* X(NM+K)*C(K1) */
+            s += x[n-1-k]*c[k];   /* X(NK)*C(K1) */
+            u += x[n-1-k]*d[k];   /* X(NK)*D(K1) */
+            v += x[k]*c[k];       /* X(K1)*C(K1) */
         }
 
         /* denominator update */
         q5 = 1.0 - g;
         q6 = 1.0 - w;
-        den = q5*q6 - cabs(h);
+        den = q5*q6 - h*h;
         if(den <= 0.0) {
-            status = DEN_ILL_CONDITIONED;
-            goto end;
+            status = AR_DEN_ILL_CONDITIONED;
+            break;
         }
 
-
         /* time shift variables update */
-        q4 = 1.0 / den;
+        q4 = 1.0/den;
         q1 *= q4;
-        alpha = 1.0 / (1.0 + (y1*q6+y3*q5+2.0*creal(h*f*b))*q1);
+        double alpha = 1.0/(1.0 + (y1*q6 + y3*q5 + 2.0*h*f*b)*q1);
         e *= alpha;
-        c1 = q4*(f*q6+conj(b*h));
-        c2 = q4*(conj(b)*q5+h*f);
-        c3 = q4*(v*q6+h*s);
-        c4 = q4*(s*q5+v*conj(h));
-        c5 = q4*(s*q6+h*u);
-        c6 = q4*(u*q5+s*conj(h));
-        for(int k = 0; k < m; k++) {
-            k1 = k+1;
-            a[k] = alpha*(a[k]+c1*c[k1]+c2*d[k1]);
+        double c1 = q4*(f*q6 + b*h);
+        double c2 = q4*(b*q5 + h*f);
+        double c3 = q4*(v*q6 + h*s);
+        double c4 = q4*(s*q5 + v*h);
+        double c5 = q4*(s*q6 + h*u);
+        double c6 = q4*(u*q5 + s*h);
+        for(int k = 1; k <= m; k++) {
+            a[k-1] = alpha*(a[k-1] + c1*c[k] + c2*d[k]);
         }
-        m2 = m/2+1;
-        for(int k = 0; k < m2; k++) {
-            mk = m+2-k;
-            save1 = conj(c[k]);
-            save2 = conj(d[k]);
-            save3 = conj(c[mk]);
-            save4 = conj(d[mk]);
-            c[k] += c3*save3+c4*save4;
-            d[k] += c5*save3+c6*save4;
+        for(int k = 0; k <= m/2; k++) {
+            int mk = m-k; /* MK = M+2-K */
+            double save1 = c[k];
+            double save2 = d[k];
+            double save3 = c[mk];
+            double save4 = d[mk];
+            c[k] += c3*save3 + c4*save4;
+            d[k] += c5*save3 + c6*save4;
             if(mk != k) {
-                c[mk] += c3*save1+c4*save2;
-                d[mk] += c5*save1+c6*save2;
+                c[mk] += c3*save1 + c4*save2;
+                d[mk] += c5*save1 + c6*save2;
             }
         }
 
-
         /* order update */
         m++;
-        nm = n-m;
-        m1 = m-1;
-        delta = 0.0;
-        c1 = conj(x[n-m]);
-        c2 = x[m-1];
-        for(int k = m1-1; k >= 0; k--) {
-            r[k+1] = r[k]-x[n+1-k]*c1-conj(x[k])*c2;
+        double edge_back = x[n-m];   /* X(N+1-M) */
+        double edge_front = x[m-1];  /* X(M) */
+        double delta = 0.0;
+        for(int k = m-2; k >= 0; k--) {
+            r[k+1] = r[k] - x[n-1-k]*edge_back - x[k]*edge_front;
             delta += r[k+1]*a[k];
         }
-        save1 = 0.0;
-        for(int k = 0; k < nm; k++) {
-            save1 += x[k+m]*conj(x[k]);
+        save = 0.0;
+        for(int k = 0; k < n-m; k++) {
+            save += x[k+m]*x[k];
         }
-        r[0] = 2.0*save1;
+        r[0] = 2.0*save;
         delta += r[0];
         q2 = -delta/e;
         a[m-1] = q2;
-        m2 = m/2;
-        for(int k = 0; k < m2; k++) {
-            mk = m-k;
-            save1 = conj(a[k]);
-            a[k] += q2*conj(a[mk]);
+        for(int k = 1; k <= m/2; k++) {
+            int mk = m-k;
+            double save1 = a[k-1];
+            a[k-1] += q2*a[mk-1];
             if(k != mk) {
-                a[mk] += q2*save1;
+                a[mk-1] += q2*save1;
             }
         }
-        y1 = cabs(q2);
+        y1 = q2*q2;
         e *= 1.0 - y1;
         if(y1 >= 1.0) {
-            status = A_ILL_CONDITIONED;
-            goto end;
+            status = AR_A_ILL_CONDITIONED;
+            break;
         }
         if(e < e0*tol1) {
-            status = TOL1_ERROR;
-            goto end;
+            status = AR_TOL1_REACHED;
+            break;
         }
         if((eold - e) < eold*tol2) {
-            status = TOL2_ERROR;
-            goto end;
+            status = AR_TOL2_REACHED;
+            break;
         }
     }
 
-    end:
-
     out_m[0] = m;
     out_e[0] = e;
     out_e0[0] = e0;
     return status;
 }
+
+ar_status_t ar_params(const double* x, int n, int mmax, double tol1, double tol2, int* out_m, double* a, double* out_e, double* out_e0) {
+    double* work = malloc(ar_params_work_size(mmax)*sizeof(double));
+    if(work == NULL) die("out of memory for marple workspace!\n");
+    ar_status_t status = ar_params_into(x, n, mmax, tol1, tol2, out_m, a, out_e, out_e0, work);
+    free(work);
+    return status;
+}
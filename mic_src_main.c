@@ -1,6 +1,39 @@
 #include "common.h"
 #include <unistd.h>
-
+#include <signal.h>
+
+/* tty-snd-mic-src:
+        without arguments, list the capture devices; otherwise record from device dev-nr
+
+        tty-snd-mic-src dev-nr time [raw|wav|stream] [-r rate] [-c channels] [-f 16|float] [-p period] [-k chunk-frames]
+        tty-snd-mic-src -L stream-file time [raw|wav|stream] [-R] [...]
+
+        (default)         time seconds as one power of two long complex stream, normalized
+        raw               time seconds of the raw pcm, as the device delivers it
+        wav               time seconds as one normalized real stream
+        stream            a complex chunk of chunk-frames samples (default 1024) as soon as it is
+                          recorded, chunk after chunk; for time seconds, or until interrupted if
+                          time is 0. Chunks are not normalized, full scale is 1
+
+        -r Hz             capture rate (default 44100); capturing at the rate the analysis wants
+                          saves the resampling and all the work on the samples it would drop
+        -c channels       1 or 2 (default 2); stereo is mixed down to the one stream
+        -f format         16 bit integers (default) or 32 bit float samples, if the implementation
+                          has AL_EXT_FLOAT32; otherwise capture falls back to 16 bit
+        -p seconds        how often the capture thread drains the device (default 0.01)
+        -k frames         samples per chunk in stream mode
+        -L file           instead of a microphone, play the (first) stream of file on an
+                          ALC_SOFT_loopback device and capture what it renders (loopback.c):
+                          no hardware needed, faster than realtime and the same on every run.
+                          Time 0 in stream mode records until the file has played out
+        -R                render the loopback at the pace of a real device
+*/
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void on_interrupt(int sig) {
+    interrupted = 1;
+}
 
 void alinfo(void) {
         printf("General AL info:\n");
@@ -12,148 +45,237 @@ void alinfo(void) {
 
 }
 
-int main(int argc, char** argv) {
-    aladLoadAL();
+/* writes every chunk as its own simple_wav as soon as it is full, so the stream can be consumed while it is recorded */
+static void stream_chunks(capture_t* capture, sample_format_t format, size_t total_frames, size_t chunk_frames) {
+    size_t frame_size = sample_frame_size(format);
+    uint8_t* pcm = malloc(chunk_frames*frame_size);
+    float* amplitudes = calloc(2*chunk_frames, sizeof(float));
+    simple_wav_t chunk = {0};
+    chunk.frequency_in_hz = (float) capture[0].sample_rate;
+    chunk.samples = amplitudes;
+
+    size_t written = 0;
+    while(written < total_frames && !interrupted) {
+        size_t wanted = chunk_frames;
+        if(total_frames - written < wanted) wanted = total_frames - written;
+        size_t filled = 0;
+        while(filled < wanted && !interrupted) {
+            size_t nr = capture_read(capture, &pcm[filled*frame_size], wanted - filled);
+            if(nr == 0) break;
+            filled += nr;
+        }
+        if(filled == 0) break;
+
+        /* into the real parts; the imaginary parts stay 0 */
+        frames_to_mono(pcm, filled, format, amplitudes, 2);
+        chunk.nr_sample_points = 2*filled;
+        write_simple_wav(stdout, chunk);
+        fflush(stdout);
+        written += filled;
+    }
 
-    if(argc < 3) {
-        printf("Available mics:\n");
-        const char* capture_dev_string = alcGetString(NULL, ALC_CAPTURE_DEVICE_SPECIFIER);
+    size_t dropped = atomic_load(&capture[0].dropped_frames);
+    if(dropped > 0) fprintf(stderr, "dropped %zu frames, the consumer was too slow!\n", dropped);
+    free(pcm);
+    free(amplitudes);
+}
 
-        int num;
-        char** devs = split(capture_dev_string, strlen(capture_dev_string), '\0', &num);
+/* fills buf with nr_frames frames, starting over as long as the device delivers nothing but silence */
+static void record_buffer(capture_t* capture, uint8_t* buf, size_t nr_frames) {
+    size_t buffersize = nr_frames*capture[0].frame_size;
+    for(int i = 0;;i++) {
+        fprintf(stderr,"iteration %i\n", i);
+
+        size_t filled = 0;
+        while(filled < nr_frames) {
+            size_t nr = capture_read(capture, &buf[filled*capture[0].frame_size], nr_frames - filled);
+            if(nr == 0) die("capture stopped early!\n");
+            filled += nr;
+        }
 
-        for(int i = 0; i < num; i++) {
-            printf("%i: %s\n", i, devs[i]);
-            free(devs[i]);
+        /* bytewise, which is the same for both sample formats: all bits 0 */
+        bool is_all_0 = true;
+        for(size_t j = 0; j < buffersize; j++) {
+            if(buf[j] != 0) {
+                is_all_0 = false;
+                break;
+            }
         }
+        if(!is_all_0) break;
+    }
+}
 
-        free(devs);
+/* scales len samples, stride apart (2: the real parts of a complex array), to a maximum
+   magnitude of 1, in place */
+static void normalize_in_place(float* samples, size_t len, size_t stride) {
+    float max = 0.0f;
+    for(size_t i = 0; i < len; i++) {
+        if(fabsf(samples[i*stride]) > max) max = fabsf(samples[i*stride]);
+    }
+    if(max == 0.0f) return;
+    for(size_t i = 0; i < len; i++) {
+        samples[i*stride] /= max;
+    }
+}
 
-        const char* default_dev = alcGetString(NULL,ALC_CAPTURE_DEFAULT_DEVICE_SPECIFIER);
-        printf("default: %s\n", default_dev);
+int main(int argc, char** argv) {
+    double period = 0.01;
+    size_t chunk_frames = 1024;
+    int rate = 44100;
+    sample_format_t format = {2, false};
+    const char* loopback_path = NULL;
+    bool realtime = false;
+    char* positional[3] = {0};
+    int nr_positional = 0;
+    for(int i = 1; i < argc; i++) {
+        if(i+1 < argc && strcmp(argv[i], "-L") == 0) {
+            loopback_path = argv[++i];
+        } else if(strcmp(argv[i], "-R") == 0) {
+            realtime = true;
+        } else if(i+1 < argc && strcmp(argv[i], "-p") == 0) {
+            period = atof(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-k") == 0) {
+            chunk_frames = atol(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-r") == 0) {
+            rate = atoi(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-c") == 0) {
+            format.channels = atoi(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-f") == 0) {
+            i++;
+            if(strcmp(argv[i], "float") == 0) format.is_float = true;
+            else if(strcmp(argv[i], "16") == 0) format.is_float = false;
+            else die("sample format has to be 16 or float!\n");
+        } else if(nr_positional < 3) {
+            positional[nr_positional++] = argv[i];
+        } else {
+            die("usage: tty-snd-mic-src [dev-nr time [raw|wav|stream]] [-L stream-file time [raw|wav|stream]] [-R] [-r rate] [-c channels] [-f 16|float] [-p period] [-k chunk-frames]\n");
+        }
+    }
+    assert(period > 0 && chunk_frames > 0 && rate > 0);
+    if(format.channels != 1 && format.channels != 2) die("only 1 or 2 channels can be captured!\n");
 
-    } else {
+    aladLoadAL();
 
-        int dev_nr = atoi(argv[1]);
-        assert(dev_nr >= 0);
+    /* with a loopback there is no device number in front of the time */
+    int time_arg = (loopback_path != NULL) ? 0 : 1;
 
+    if(nr_positional < time_arg+1) {
+        printf("Available mics:\n");
         const char* capture_dev_string = alcGetString(NULL, ALC_CAPTURE_DEVICE_SPECIFIER);
 
         int num;
         char** devs = split(capture_dev_string, strlen(capture_dev_string), '\0', &num);
-        assert(dev_nr < num);
-
-
-        float time = atof(argv[2]);
-
-        size_t buffersize = 44100*time*2;
-
-        fprintf(stderr, "chosen dev: %s\n", devs[dev_nr]);
-
-        ALCdevice* capture = alcCaptureOpenDevice(devs[dev_nr], 44100, AL_FORMAT_STEREO16, buffersize*100);
 
         for(int i = 0; i < num; i++) {
+            printf("%i: %s\n", i, devs[i]);
             free(devs[i]);
         }
 
         free(devs);
 
-        int code = alcGetError(capture);
-        if(code != ALC_NO_ERROR)  {
-            fprintf(stderr,"error %i\n", code);
-            exit(-1);
-        }
-
-        if(capture == NULL) die("no mic found");
-
-
-
-        alcCaptureStart(capture);
-        int16_t* buf = calloc(sizeof(int16_t), buffersize*10);
+        const char* default_dev = alcGetString(NULL,ALC_CAPTURE_DEFAULT_DEVICE_SPECIFIER);
+        printf("default: %s\n", default_dev);
 
-        code = alcGetError(capture);
-        if(code != ALC_NO_ERROR)  {
-            fprintf(stderr,"error %i\n", code);
-            exit(-1);
-        }
+    } else {
 
-        assert(usleep(time*1000000) == 0);
+        const char* mode = (positional[time_arg+1] != NULL) ? positional[time_arg+1] : "";
+        bool streaming = (strcmp(mode, "stream") == 0);
 
-        for(int i = 0;;i++) {
+        float time = atof(positional[time_arg]);
+        assert(time > 0 || (streaming && time == 0));
 
-            fprintf(stderr,"iteration %i\n", i);
+        size_t nr_frames = (size_t)(rate*time);
 
-            int currently_recorded_samples = 0;
-            while(currently_recorded_samples < buffersize) {
-                alcGetIntegerv(capture, ALC_CAPTURE_SAMPLES, sizeof(int), &currently_recorded_samples);
-                fprintf(stderr,"size: %i\n", currently_recorded_samples);
-            }
+        ALCdevice* capture = NULL;
+        loopback_t loopback;
+        simple_wav_t played = {0};
+        capture_t capture_stream;
+        if(loopback_path != NULL) {
+            FILE* fp = fopen(loopback_path, "rb");
+            if(fp == NULL) die("could not open the stream for the loopback!\n");
+            played = read_simple_wav(fp);
+            fclose(fp);
+            if(!open_loopback(&loopback, rate, format)) die("no loopback device!\n");
+            loopback_play_stream(&loopback, &played);
+            start_loopback_capture(&capture_stream, &loopback, period, 2.0, realtime);
+        } else {
+            int dev_nr = atoi(positional[0]);
+            assert(dev_nr >= 0);
 
+            /* the device only has to hold what arrives between two drains of the capture thread; give it half a second */
+            capture = open_capture_device(dev_nr, rate, &format, rate/2);
 
-            alcCaptureSamples(capture, buf, buffersize);
+            if(capture == NULL) die("no mic found");
 
             int code = alcGetError(capture);
             if(code != ALC_NO_ERROR)  {
                 fprintf(stderr,"error %i\n", code);
-                break;
-            }
-
-            bool is_all_0 = true;
-            for(int i = 0; i < buffersize; i++) {
-                if(buf[i] != 0) {
-                    is_all_0 = false;
-                    break;
-                }
+                exit(-1);
             }
-            if(!is_all_0) break;
 
+            start_capture(&capture_stream, capture, sample_frame_size(format), rate, period, 2.0);
         }
-        alcCaptureStop(capture);
 
+        if(streaming) {
+            signal(SIGINT, on_interrupt);
+            signal(SIGTERM, on_interrupt);
+            size_t total_frames = (time > 0) ? nr_frames : SIZE_MAX;
+            stream_chunks(&capture_stream, format, total_frames, chunk_frames);
+            stop_capture(&capture_stream);
+        } else {
+            uint8_t* buf = calloc(sample_frame_size(format), nr_frames);
+            record_buffer(&capture_stream, buf, nr_frames);
+            stop_capture(&capture_stream);
 
 
-        //Raw output for debug, courtesy of @Llamato on github
-        if(argc > 3 && strcmp(argv[3], "raw") == 0) {
-            //Write raw pcm directly to stdout
-            fwrite(buf, sizeof(int16_t), buffersize, stdout);
-            fprintf(stderr, "%s\n", "writing raw to stdout");
-        }
-        else if(argc > 3 && strcmp(argv[3], "wav") == 0) {
-            simple_wav_t raw_form  = {0};
-            raw_form.frequency_in_hz = 44100.0f;
-            raw_form.nr_sample_points = truncate_power_of_2(buffersize/2);
-            float* raw_copy = calloc(sizeof(float), raw_form.nr_sample_points);
-            for(int i = 0; i < raw_form.nr_sample_points; i++) {
-                raw_copy[i] = (float) buf[2*i];
+
+            //Raw output for debug, courtesy of @Llamato on github
+            if(strcmp(mode, "raw") == 0) {
+                //Write raw pcm directly to stdout
+                fwrite(buf, sample_frame_size(format), nr_frames, stdout);
+                fprintf(stderr, "%s\n", "writing raw to stdout");
             }
-            float * norm_copy = normalize_float_array(raw_copy, raw_form.nr_sample_points);
-            raw_form.samples = norm_copy;
-            write_simple_wav(stdout, raw_form);
-            free(raw_copy);
-        }
-        else {
-            size_t len = truncate_power_of_2(buffersize/2);
-            float freq = ((float)44100);
-            if(!is_power_of_2(len)) die("Data size collected not power of two!");
-
-            float* raw_copy = calloc(sizeof(float), len);
-            for(int i = 0; i < len; i++) {
-                raw_copy[i] = (float) buf[2*i];
+            else if(strcmp(mode, "wav") == 0) {
+                simple_wav_t raw_form  = {0};
+                raw_form.frequency_in_hz = (float) rate;
+                raw_form.nr_sample_points = truncate_power_of_2(nr_frames);
+                float* samples = malloc(raw_form.nr_sample_points*sizeof(float));
+                frames_to_mono(buf, raw_form.nr_sample_points, format, samples, 1);
+                normalize_in_place(samples, raw_form.nr_sample_points, 1);
+                raw_form.samples = samples;
+                write_simple_wav(stdout, raw_form);
+                free(samples);
+            }
+            else {
+                size_t len = truncate_power_of_2(nr_frames);
+                float freq = ((float)rate);
+                if(!is_power_of_2(len)) die("Data size collected not power of two!");
+
+                /* straight into the real parts of the complex stream */
+                float* amplitudes = calloc(2*len, sizeof(float));
+                frames_to_mono(buf, len, format, amplitudes, 2);
+                normalize_in_place(amplitudes, len, 2);
+
+                simple_wav_t float_form = {0};
+                float_form.frequency_in_hz = freq;
+                float_form.nr_sample_points = 2*len;
+                float_form.samples = amplitudes;
+
+                write_simple_wav(stdout, float_form);
+                free(amplitudes);
             }
-            float * norm_copy = normalize_float_array(raw_copy, len);
-            float* amplitudes = transform_float_to_complex_array(norm_copy, len);
 
-            simple_wav_t float_form = {0};
-            float_form.frequency_in_hz = freq;
-            float_form.nr_sample_points = 2*len;
-            float_form.samples = amplitudes;
+            free(buf);
 
-            write_simple_wav(stdout, float_form);
         }
 
-
-
-        alcCaptureCloseDevice(capture);
+        if(loopback_path != NULL) {
+            close_loopback(&loopback);
+            free(played.samples);
+            free(played.peaks);
+        } else {
+            alcCaptureCloseDevice(capture);
+        }
     }
 
     aladTerminate();
@@ -0,0 +1,97 @@
+#include "common.h"
+
+/*
+ * A min/max decimation pyramid: level 0 is the data, and every entry of level l+1 holds the
+ * minimum and maximum of two entries of level l, so an entry of level l covers 2^l samples.
+ * Drawing any range of the data over a number of columns then takes the level whose entries
+ * are just not wider than a column, and a column is the min/max of at most four of them:
+ * the work per redraw depends on the columns, not on the length of the data, and no peak
+ * between two drawn points is lost the way it would be by skipping samples.
+ */
+
+void create_minmax_pyramid(minmax_pyramid_t* pyramid, const float* data, size_t len) {
+    assert(len > 0);
+    int nr_levels = 1;
+    while(((size_t) 1 << (nr_levels-1)) < len) nr_levels++;
+
+    pyramid[0].len = len;
+    pyramid[0].nr_levels = nr_levels;
+    pyramid[0].level_len = malloc(nr_levels*sizeof(size_t));
+    pyramid[0].min = malloc(nr_levels*sizeof(float*));
+    pyramid[0].max = malloc(nr_levels*sizeof(float*));
+
+    /* level 0 is the data itself, its minimum and maximum are the same */
+    pyramid[0].level_len[0] = len;
+    pyramid[0].min[0] = (float*) data;
+    pyramid[0].max[0] = (float*) data;
+    for(int l = 1; l < nr_levels; l++) {
+        size_t prev_len = pyramid[0].level_len[l-1];
+        size_t level_len = (prev_len + 1)/2;
+        float* prev_min = pyramid[0].min[l-1];
+        float* prev_max = pyramid[0].max[l-1];
+        float* min = malloc(level_len*sizeof(float));
+        float* max = malloc(level_len*sizeof(float));
+        if(min == NULL || max == NULL) die("out of memory for the min/max pyramid!\n");
+        for(size_t i = 0; i < prev_len/2; i++) {
+            min[i] = fminf(prev_min[2*i], prev_min[2*i+1]);
+            max[i] = fmaxf(prev_max[2*i], prev_max[2*i+1]);
+        }
+        /* an odd entry out at the end is carried up as it is */
+        if(prev_len % 2 == 1) {
+            min[level_len-1] = prev_min[prev_len-1];
+            max[level_len-1] = prev_max[prev_len-1];
+        }
+        pyramid[0].level_len[l] = level_len;
+        pyramid[0].min[l] = min;
+        pyramid[0].max[l] = max;
+    }
+}
+
+void destroy_minmax_pyramid(minmax_pyramid_t* pyramid) {
+    for(int l = 1; l < pyramid[0].nr_levels; l++) {
+        free(pyramid[0].min[l]);
+        free(pyramid[0].max[l]);
+    }
+    free(pyramid[0].level_len);
+    free(pyramid[0].min);
+    free(pyramid[0].max);
+    memset(pyramid, 0, sizeof(minmax_pyramid_t));
+}
+
+/* the minimum and maximum of the samples in each of nr_columns equal columns of [first, last),
+   which is clipped to the data; a column narrower than a sample gets the sample it lies in.
+   Returns the level it was read from */
+int minmax_pyramid_columns(const minmax_pyramid_t* pyramid, double first, double last, size_t nr_columns, float* col_min, float* col_max) {
+    assert(nr_columns > 0 && last > first);
+    double len = pyramid[0].len;
+    double per_column = (last - first)/nr_columns;
+
+    /* the coarsest level whose entries are not wider than a column */
+    int level = 0;
+    while(level+1 < pyramid[0].nr_levels && (double)((size_t) 1 << (level+1)) <= per_column) level++;
+    double entry = (double)((size_t) 1 << level);
+    const float* min = pyramid[0].min[level];
+    const float* max = pyramid[0].max[level];
+    size_t level_len = pyramid[0].level_len[level];
+
+    for(size_t c = 0; c < nr_columns; c++) {
+        double a = first + c*per_column;
+        double b = a + per_column;
+        a = (a < 0) ? 0 : (a > len) ? len : a;
+        b = (b < 0) ? 0 : (b > len) ? len : b;
+        size_t lo = (size_t) floor(a/entry);
+        size_t hi = (size_t) ceil(b/entry);
+        if(hi <= lo) hi = lo+1;
+        if(hi > level_len) hi = level_len;
+        if(lo >= hi) lo = hi-1;
+
+        float cmin = min[lo], cmax = max[lo];
+        for(size_t i = lo+1; i < hi; i++) {
+            if(min[i] < cmin) cmin = min[i];
+            if(max[i] > cmax) cmax = max[i];
+        }
+        col_min[c] = cmin;
+        col_max[c] = cmax;
+    }
+    return level;
+}
@@ -9,8 +9,23 @@ int main(int argc, char** argv) {
     int order = atoi(argv[1]);
     int maxbw = atoi(argv[2]);
     int minformant = atoi(argv[3]);
+    /* -f: peaks of the LPC envelope instead of root solving; -m method: the LPC method of
+       lpc_engine.c (autocorrelation, covariance, burg, marple or rosa) instead of autocorrelation */
+    bool fast = false;
+    lpc_method_t method = LPC_AUTOCORRELATION;
+    for(int i = 4; i < argc; i++) {
+        if(strcmp(argv[i], "-f") == 0) {
+            fast = true;
+        } else if(i+1 < argc && strcmp(argv[i], "-m") == 0) {
+            if(!lpc_method_from_name(argv[++i], &method)) die("unknown LPC method!\n");
+        } else {
+            die("usage: tty-snd-nftest order maxbw minformant [-f] [-m method]\n");
+        }
+    }
 
     simple_wav_t float_form = read_simple_wav(stdin);
+    /* 0 is phonTools' default order; resolved here, since the engine and the arrays are sized for it */
+    if(order == 0) order = r_default_order(float_form.frequency_in_hz);
 
 
 
@@ -18,15 +33,17 @@ int main(int argc, char** argv) {
 	double* bws = calloc(order, sizeof(double));
 	bool* is_selected = calloc(order, sizeof(bool));
 	size_t len = float_form.nr_sample_points / 2;
-	
-	double* data = calloc(len, sizeof(double));
-	for(int i = 0; i < len; i++) {
-		data[i] = float_form.samples[2*i];
-	}
 
-	r_find_formants(data, len, float_form.frequency_in_hz, order, maxbw, minformant, formants, bws, is_selected);
+	lpc_engine_t engine = create_lpc_engine(method, order, len);
+	if(fast) {
+		r_find_formants_fft(&engine, float_form.samples, 2, len, float_form.frequency_in_hz, order, maxbw, minformant, formants, bws, is_selected);
+	} else {
+		r_find_formants(&engine, float_form.samples, 2, len, float_form.frequency_in_hz, order, maxbw, minformant, formants, bws, is_selected);
+	}
+	
+	destroy_lpc_engine(&engine);
 	
-	printf("formant values by R algorithm (order = %i, maxbw = %i, minformant = %i): \n", order, maxbw, minformant);
+	printf("formant values by R algorithm%s, %s LPC (order = %i, maxbw = %i, minformant = %i): \n", fast ? " (envelope)" : "", lpc_method_name(method), order, maxbw, minformant);
 	for(int i = 0; i < order; i++) {
 		printf("[%i]: %f +- %f Hz, selected: %i\n", i, formants[i], bws[i], is_selected[i]);
 	}
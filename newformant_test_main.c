@@ -50,16 +50,16 @@ int main(int argc, char** argv) {
     /*
 
     printf("lpc = [");
-    double* lpc_params = lpc_coefficients_rosa_double(data, out_form.nr_sample_points, order);
+    double* lpc_params = lpc_coefficients_rosa_d(data, out_form.nr_sample_points, order);
     for(int i = 0; i < order+1; i++) {
         printf("%f,", lpc_params[i]);
     }
     printf("]\n");
 
     double* marple_lpc = calloc(order+1, sizeof(double));
-    float e, e0; int nr_formants_calculated;
-    int status = ar_params(data, out_form.nr_sample_points, order, 0.005, 0.005, &nr_formants_calculated, marple_lpc, &e, &e0);
-    if(status == 0) {
+    double e, e0; int nr_formants_calculated;
+    ar_status_t status = ar_params(data, out_form.nr_sample_points, order, 0.005, 0.005, &nr_formants_calculated, marple_lpc, &e, &e0);
+    if(status == AR_SUCCESS) {
         printf("marple_lpc = [");
         for(int i = 0; i < nr_formants_calculated; i++) {
             printf("%f,", marple_lpc[i]);
@@ -5,8 +5,24 @@
 int main(int argc, char** argv) {
     simple_wav_t float_form = read_simple_wav(stdin);
 
+    /* -f file: write the formant families as a table instead of the debug printout ("-" for stderr) */
+    const char* families_file = NULL;
+    if(argc > 2 && strcmp(argv[1], "-f") == 0) {
+        families_file = argv[2];
+    }
+
     if(float_form.nr_peaks == 0) {
         fprintf(stderr, "No peaks found!\n");
+    } else if(families_file != NULL) {
+        peak_family_t* families = calloc(float_form.nr_peaks, sizeof(peak_family_t));
+        double vtl;
+        size_t nr_families = group_peak_families(float_form.peaks, float_form.nr_peaks, 0.01f, 30.0, families, &vtl);
+
+        FILE* fp = (strcmp(families_file, "-") == 0) ? stderr : fopen(families_file, "w");
+        if(fp == NULL) die("could not open families file!\n");
+        write_peak_families(fp, families, nr_families, vtl);
+        if(fp != stderr) fclose(fp);
+        free(families);
     } else {
         fprintf(stderr, "Peaks found!\nPRINTOUT:\n");
         debug_peaks(float_form.peaks, float_form.nr_peaks);
@@ -0,0 +1,110 @@
+#include "common.h"
+
+/*
+ * Groups peaks into formant families: peaks whose pitch classes (the position within the
+ * octave, in cents) lie within tolerance_cents of each other are counted as harmonics of
+ * the same family. This is what debug_peaks does for its printout, but with a hash table
+ * over the pitch class instead of comparing every peak with every family found so far.
+ *
+ * Families are created at least tolerance_cents apart, so with buckets that are (at least)
+ * tolerance_cents wide every bucket holds at most a couple of families and a peak only has
+ * to look at its own bucket and the two neighbouring ones.
+ */
+
+#define CENTS_PER_OCTAVE 1200.0
+#define SPEED_OF_SOUND_M_PER_S 343.0
+
+static double pitch_class_in_cents(double octave_nr) {
+    double cents = fmod(octave_nr*CENTS_PER_OCTAVE, CENTS_PER_OCTAVE);
+    if(cents < 0.0) cents += CENTS_PER_OCTAVE;
+    return cents;
+}
+
+/* distance within the octave, so B and the C above it are close */
+static double pitch_class_distance(double a, double b) {
+    double d = fabs(a - b);
+    return (d > CENTS_PER_OCTAVE/2) ? CENTS_PER_OCTAVE - d : d;
+}
+
+size_t group_peak_families(const peak_t* peaks, size_t nr_peaks, float min_height, double tolerance_cents, peak_family_t* families_out, double* vtl_out) {
+    assert(tolerance_cents > 0.0 && tolerance_cents <= CENTS_PER_OCTAVE/3);
+
+    int nr_buckets = (int) floor(CENTS_PER_OCTAVE / tolerance_cents);
+    double bucket_width = CENTS_PER_OCTAVE / nr_buckets;
+    /* chained hash table: bucket heads and per-family next links, -1 terminated */
+    int* bucket_head = malloc(nr_buckets*sizeof(int));
+    int* next_in_bucket = malloc((nr_peaks > 0 ? nr_peaks : 1)*sizeof(int));
+    for(int b = 0; b < nr_buckets; b++) bucket_head[b] = -1;
+
+    size_t nr_found = 0;
+    size_t nr_valid = 0;
+    float first_freq = 0.0f, last_freq = 0.0f;
+
+    for(size_t i = 0; i < nr_peaks; i++) {
+        if(peaks[i].freq == -1.0f) continue;
+        if(peaks[i].height < min_height) continue;
+        double octave_nr = hz_to_octave(peaks[i].freq);
+        if(octave_nr < 0 || octave_nr > 10) continue; /* same range note_name accepts */
+
+        if(nr_valid == 0) first_freq = peaks[i].freq;
+        last_freq = peaks[i].freq;
+        nr_valid++;
+
+        double cents = pitch_class_in_cents(octave_nr);
+        int bucket = ((int) floor(cents / bucket_width)) % nr_buckets;
+
+        bool found = false;
+        for(int offset = -1; offset <= 1; offset++) {
+            int b = (bucket + offset + nr_buckets) % nr_buckets;
+            for(int j = bucket_head[b]; j != -1; j = next_in_bucket[j]) {
+                if(pitch_class_distance(families_out[j].pitch_class_cents, cents) < tolerance_cents) {
+                    if(peaks[i].height > families_out[j].max_height)
+                        families_out[j].max_height = peaks[i].height;
+                    if(peaks[i].formant_nr < families_out[j].lowest_formant)
+                        families_out[j].lowest_formant = peaks[i].formant_nr;
+                    families_out[j].nr_harmonics++;
+                    found = true;
+                }
+            }
+        }
+
+        if(!found) {
+            families_out[nr_found].freq = peaks[i].freq;
+            families_out[nr_found].octave_nr = octave_nr;
+            families_out[nr_found].pitch_class_cents = cents;
+            families_out[nr_found].max_height = peaks[i].height;
+            families_out[nr_found].lowest_formant = peaks[i].formant_nr;
+            families_out[nr_found].nr_harmonics = 0;
+            next_in_bucket[nr_found] = bucket_head[bucket];
+            bucket_head[bucket] = nr_found;
+            nr_found++;
+        }
+    }
+
+    if(vtl_out != NULL) {
+        /* peaks are sorted by frequency, so the mean spacing needs no second pass */
+        if(nr_valid > 1 && last_freq > first_freq) {
+            double mean_distance = (last_freq - first_freq) / (nr_valid - 1);
+            vtl_out[0] = SPEED_OF_SOUND_M_PER_S/(2*mean_distance);
+        } else {
+            vtl_out[0] = 0.0;
+        }
+    }
+
+    free(bucket_head);
+    free(next_in_bucket);
+    return nr_found;
+}
+
+/* tab separated, one family per line, summary lines start with '#' */
+void write_peak_families(FILE* fp, const peak_family_t* families, size_t nr_families, double vtl) {
+    fprintf(fp, "family\tfreq_hz\tnote\tlowest_formant\tharmonics\tmax_height\n");
+    for(size_t j = 0; j < nr_families; j++) {
+        char* name = note_name(families[j].octave_nr, NULL, NULL, NULL);
+        fprintf(fp, "%zu\t%f\t%s\t%i\t%i\t%f\n", j, families[j].freq, (name != NULL) ? name : "-",
+            families[j].lowest_formant, families[j].nr_harmonics, families[j].max_height);
+        free(name);
+    }
+    fprintf(fp, "#families\t%zu\n", nr_families);
+    fprintf(fp, "#vtl_m\t%f\n", vtl);
+}
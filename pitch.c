@@ -0,0 +1,253 @@
+#include "common.h"
+
+/*
+ * Frame-by-frame F0 with YIN: for every frame the difference function
+ *
+ *      d(tau) = sum_{j<W} (x[j] - x[j+tau])^2 = e(0) + e(tau) - 2 r(tau)
+ *
+ * is built from the energies e (running sums) and the cross-correlation r of the first W samples
+ * with the whole frame, which is one product of two FFTs. The cumulative mean normalized
+ * difference d'(tau) = d(tau) tau / sum_{k<=tau} d(k) is then searched for the first dip below
+ * the threshold; taking the first dip instead of the global minimum is what keeps YIN from
+ * jumping an octave down. The frame is voiced if that dip exists.
+ *
+ * Frames are handed to the thread pool in chunks, and the transforms of a chunk run as one
+ * batch, so the twiddle factors are computed once per chunk and nothing is allocated per frame.
+ */
+
+#define PITCH_FRAMES_PER_JOB 16
+
+void init_pitch_params(pitch_params_t* params) {
+    params[0].min_f0 = 75.0;
+    params[0].max_f0 = 600.0;
+    params[0].time_step = 0.01;
+    params[0].threshold = 0.15;
+    params[0].nr_threads = default_thread_count();
+}
+
+typedef struct pitch_job_t {
+    const float* samples;
+    size_t stride;
+    double sample_rate;
+    size_t window, max_lag, min_lag, frame_len, hop, fft_len;
+    double threshold;
+    pitch_track_t* track;
+    snd_real_t** buffers; /* per thread */
+} pitch_job_t;
+
+static size_t pitch_buffer_size(size_t fft_len, size_t max_lag) {
+    /* two batches of transforms, the fft scratch, the energies and d'(tau) */
+    return 2*PITCH_FRAMES_PER_JOB*2*fft_len + fft_batch_work_size(2*fft_len) + 2*(max_lag+2);
+}
+
+/* first dip of d' below the threshold, or the global minimum if there is none; with parabolic interpolation */
+static double pick_period(const snd_real_t* cmndf, size_t min_lag, size_t max_lag, double threshold, double* value_out, bool* voiced_out) {
+    size_t best = min_lag;
+    bool found = false;
+    for(size_t tau = min_lag; tau <= max_lag; tau++) {
+        if(cmndf[tau] < threshold) {
+            while(tau+1 <= max_lag && cmndf[tau+1] < cmndf[tau]) tau++;
+            best = tau;
+            found = true;
+            break;
+        }
+        if(cmndf[tau] < cmndf[best]) best = tau;
+    }
+
+    double period = best;
+    double value = cmndf[best];
+    if(best > min_lag && best < max_lag) {
+        double a = cmndf[best-1], b = cmndf[best], c = cmndf[best+1];
+        double curvature = a - 2*b + c;
+        if(curvature > 0.0) {
+            double offset = 0.5*(a - c)/curvature;
+            period += offset;
+            value = b - 0.25*(a - c)*offset;
+        }
+    }
+    value_out[0] = value;
+    voiced_out[0] = found;
+    return period;
+}
+
+static void analyze_pitch_frames(void* ctx, int thread_nr, size_t job_nr) {
+    pitch_job_t* job = ctx;
+    pitch_track_t* track = job[0].track;
+    size_t fft_len = job[0].fft_len; /* complex points */
+    size_t first = job_nr*PITCH_FRAMES_PER_JOB;
+    size_t last = first + PITCH_FRAMES_PER_JOB;
+    if(last > track[0].nr_frames) last = track[0].nr_frames;
+    size_t nr = last - first;
+
+    snd_real_t* head = job[0].buffers[thread_nr];          /* first W samples, zero padded */
+    snd_real_t* frame = &head[PITCH_FRAMES_PER_JOB*2*fft_len]; /* the whole frame, zero padded */
+    snd_real_t* work = &frame[PITCH_FRAMES_PER_JOB*2*fft_len];
+    snd_real_t* energy = &work[fft_batch_work_size(2*fft_len)];
+    snd_real_t* cmndf = &energy[job[0].max_lag+2];
+
+    memset(head, 0, 2*nr*2*fft_len*sizeof(snd_real_t));
+    for(size_t f = 0; f < nr; f++) {
+        const float* x = &job[0].samples[(first+f)*job[0].hop*job[0].stride];
+        snd_real_t* h = &head[f*2*fft_len];
+        snd_real_t* b = &frame[f*2*fft_len];
+        for(size_t i = 0; i < job[0].frame_len; i++) {
+            b[2*i] = x[i*job[0].stride];
+        }
+        for(size_t i = 0; i < job[0].window; i++) {
+            h[2*i] = b[2*i];
+        }
+    }
+
+    fft_power_of_two_batch(head, head, 2*fft_len, nr, false, work);
+    fft_power_of_two_batch(frame, frame, 2*fft_len, nr, false, work);
+    /* conj(H) * B, whose inverse transform is r(tau) = sum_j h[j] b[j+tau] */
+    for(size_t i = 0; i < nr*fft_len; i++) {
+        double hr = head[2*i], hi = head[2*i+1], br = frame[2*i], bi = frame[2*i+1];
+        head[2*i] = hr*br + hi*bi;
+        head[2*i+1] = hr*bi - hi*br;
+    }
+    fft_power_of_two_batch(head, head, 2*fft_len, nr, true, work);
+
+    size_t window = job[0].window;
+    size_t max_lag = job[0].max_lag;
+    for(size_t f = 0; f < nr; f++) {
+        /* the frame buffer holds its transform by now, so the energies come from the samples */
+        const float* x = &job[0].samples[(first+f)*job[0].hop*job[0].stride];
+        const snd_real_t* r = &head[f*2*fft_len];
+
+        /* e(tau) = sum_{j<W} x[j+tau]^2 as a sliding sum */
+        double e = 0.0;
+        for(size_t j = 0; j < window; j++) e += (double) x[j*job[0].stride]*x[j*job[0].stride];
+        energy[0] = e;
+        for(size_t tau = 1; tau <= max_lag+1; tau++) {
+            double out = x[(tau-1)*job[0].stride], in = x[(tau-1+window)*job[0].stride];
+            e += in*in - out*out;
+            energy[tau] = e;
+        }
+
+        size_t index = first+f;
+        if(energy[0] <= 1e-12*window) {
+            track[0].f0[index] = NAN;
+            track[0].strength[index] = 0.0;
+            continue;
+        }
+
+        double running = 0.0;
+        cmndf[0] = 1.0;
+        for(size_t tau = 1; tau <= max_lag+1; tau++) {
+            double d = energy[0] + energy[tau] - 2*r[2*tau];
+            if(d < 0.0) d = 0.0; /* rounding */
+            running += d;
+            cmndf[tau] = (running > 0.0) ? d*tau/running : 1.0;
+        }
+
+        double value;
+        bool voiced;
+        double period = pick_period(cmndf, job[0].min_lag, max_lag, job[0].threshold, &value, &voiced);
+        double strength = 1.0 - value;
+        track[0].strength[index] = (strength < 0.0) ? 0.0 : (strength > 1.0) ? 1.0 : strength;
+        track[0].f0[index] = voiced ? job[0].sample_rate/period : NAN;
+    }
+}
+
+pitch_workspace_t create_pitch_workspace(int nr_threads) {
+    if(nr_threads < 1) nr_threads = 1;
+    if(nr_threads > MAX_THREADS) nr_threads = MAX_THREADS;
+    pitch_workspace_t workspace = {0};
+    workspace.nr_threads = nr_threads;
+    workspace.buffers = calloc(nr_threads, sizeof(snd_real_t*));
+    return workspace;
+}
+
+void destroy_pitch_workspace(pitch_workspace_t* workspace) {
+    for(int t = 0; t < workspace[0].nr_threads; t++) free(workspace[0].buffers[t]);
+    free(workspace[0].buffers);
+    workspace[0].buffers = NULL;
+    workspace[0].buffer_size = 0;
+    workspace[0].nr_threads = 0;
+}
+
+/* buffers only ever grow, so sounds of one rate and pitch range reuse them as they are */
+static void prepare_pitch_workspace(pitch_workspace_t* workspace, size_t buffer_size) {
+    if(buffer_size <= workspace[0].buffer_size) return;
+    for(int t = 0; t < workspace[0].nr_threads; t++) {
+        free(workspace[0].buffers[t]);
+        workspace[0].buffers[t] = malloc(buffer_size*sizeof(snd_real_t));
+        if(workspace[0].buffers[t] == NULL) die("out of memory for pitch workspace!\n");
+    }
+    workspace[0].buffer_size = buffer_size;
+}
+
+pitch_track_t track_pitch(const float* samples, size_t stride, size_t len, double sample_rate, const pitch_params_t* params) {
+    pitch_workspace_t workspace = create_pitch_workspace(params[0].nr_threads);
+    pitch_track_t track = track_pitch_with(&workspace, samples, stride, len, sample_rate, params);
+    destroy_pitch_workspace(&workspace);
+    return track;
+}
+
+/* as track_pitch, with the per-thread buffers of the workspace; uses at most workspace[0].nr_threads threads */
+pitch_track_t track_pitch_with(pitch_workspace_t* workspace, const float* samples, size_t stride, size_t len, double sample_rate, const pitch_params_t* params) {
+    assert(params[0].min_f0 > 0.0 && params[0].max_f0 > params[0].min_f0);
+    pitch_track_t track = {0};
+
+    pitch_job_t job;
+    job.samples = samples;
+    job.stride = stride;
+    job.sample_rate = sample_rate;
+    job.threshold = params[0].threshold;
+    job.max_lag = (size_t) ceil(sample_rate/params[0].min_f0);
+    job.min_lag = (size_t) floor(sample_rate/params[0].max_f0);
+    if(job.min_lag < 2) job.min_lag = 2;
+    job.window = job.max_lag;
+    /* one lag past the maximum for the interpolation, and one more sample for the sliding sum */
+    job.frame_len = job.window + job.max_lag + 2;
+    job.hop = (size_t) round(params[0].time_step*sample_rate);
+    if(job.hop < 1) job.hop = 1;
+    /* the head is zero past W, so the circular correlation does not wrap for lags up to max_lag+1 */
+    job.fft_len = 1;
+    while(job.fft_len < job.frame_len) job.fft_len <<= 1;
+    job.track = &track;
+
+    if(len < job.frame_len || job.min_lag >= job.max_lag) return track;
+    track.nr_frames = (len - job.frame_len)/job.hop + 1;
+    track.time_step = job.hop/sample_rate;
+    track.first_time = 0.5*job.frame_len/sample_rate;
+    track.f0 = malloc(track.nr_frames*sizeof(double));
+    track.strength = malloc(track.nr_frames*sizeof(double));
+
+    int nr_threads = params[0].nr_threads;
+    if(nr_threads < 1) nr_threads = 1;
+    if(nr_threads > workspace[0].nr_threads) nr_threads = workspace[0].nr_threads;
+    prepare_pitch_workspace(workspace, pitch_buffer_size(job.fft_len, job.max_lag));
+    job.buffers = workspace[0].buffers;
+
+    parallel_for((track.nr_frames + PITCH_FRAMES_PER_JOB-1)/PITCH_FRAMES_PER_JOB, nr_threads, analyze_pitch_frames, &job);
+    return track;
+}
+
+void destroy_pitch_track(pitch_track_t* track) {
+    free(track[0].f0);
+    free(track[0].strength);
+    track[0].f0 = track[0].strength = NULL;
+    track[0].nr_frames = 0;
+}
+
+/* mean F0 over the voiced frames, NAN if there are none */
+double pitch_track_mean(const pitch_track_t* track) {
+    double sum = 0.0;
+    size_t nr = 0;
+    for(size_t f = 0; f < track[0].nr_frames; f++) {
+        if(isnan(track[0].f0[f])) continue;
+        sum += track[0].f0[f];
+        nr++;
+    }
+    return (nr > 0) ? sum/nr : NAN;
+}
+
+/* tab separated: time, F0 (nan if unvoiced), periodicity strength and the voicing decision */
+void write_pitch_track(FILE* fp, const pitch_track_t* track) {
+    fprintf(fp, "time\tf0\tstrength\tvoiced\n");
+    for(size_t f = 0; f < track[0].nr_frames; f++) {
+        fprintf(fp, "%f\t%f\t%f\t%i\n", track[0].first_time + f*track[0].time_step, track[0].f0[f], track[0].strength[f], !isnan(track[0].f0[f]));
+    }
+}
@@ -0,0 +1,62 @@
+#include "common.h"
+
+/* tty-snd-pitch:
+        read in a sound stream and print its F0 track (time, F0, strength, voiced) as a table,
+        followed by the mean F0 over the voiced frames
+
+        -t threads        number of analysis threads (default: all cores)
+        -s seconds        time step (default 0.01)
+        -f Hz             pitch floor (default 75)
+        -c Hz             pitch ceiling (default 600)
+        -y value          voicing threshold on the normalized difference (default 0.15)
+        -q                only print the mean, as the "F0(Hz) value" line of run_on_wavs.sh
+*/
+
+
+
+int main(int argc, char** argv) {
+    pitch_params_t params;
+    init_pitch_params(&params);
+    bool only_mean = false;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-q") == 0) {
+            only_mean = true;
+        } else if(i+1 < argc && strcmp(argv[i], "-t") == 0) {
+            params.nr_threads = atoi(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-s") == 0) {
+            params.time_step = atof(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-f") == 0) {
+            params.min_f0 = atof(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-c") == 0) {
+            params.max_f0 = atof(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-y") == 0) {
+            params.threshold = atof(argv[++i]);
+        } else {
+            die("usage: tty-snd-pitch [-t threads] [-s time-step] [-f floor] [-c ceiling] [-y threshold] [-q]\n");
+        }
+    }
+    assert(params.time_step > 0 && params.min_f0 > 0 && params.max_f0 > params.min_f0 && params.threshold > 0);
+
+    simple_wav_t float_form = read_simple_wav(stdin);
+
+    /* samples are complex, the sound is in the real parts */
+    size_t len = float_form.nr_sample_points / 2;
+    pitch_track_t track = track_pitch(float_form.samples, 2, len, float_form.frequency_in_hz, &params);
+    if(track.nr_frames == 0) {
+        fprintf(stderr, "stream too short for a single analysis window!\n");
+    }
+
+    if(only_mean) {
+        printf("F0(Hz) %f\n", pitch_track_mean(&track));
+    } else {
+        write_pitch_track(stdout, &track);
+        printf("# F0(Hz) %f\n", pitch_track_mean(&track));
+    }
+
+    destroy_pitch_track(&track);
+    free(float_form.samples);
+    free(float_form.peaks);
+
+    return 0;
+}
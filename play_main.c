@@ -1,6 +1,31 @@
 #include "common.h"
 #include <unistd.h>
 
+/* tty-snd-play:
+        without arguments, list the output devices; otherwise play the sound stream(s) on stdin
+        on device dev-nr
+
+        tty-snd-play dev-nr [-k frames] [-f 16|float] [-g gain]
+        tty-snd-play -L out-file [-k frames] [-f 16|float] [-g gain]
+
+        The real parts of the stream are played as they come in: a few AL buffers of a period
+        each are queued on the source and refilled as soon as the source is done with them, so
+        playback starts with the first period and memory stays the same for any stream length.
+        Consecutive streams (the chunks of tty-snd-mic-src stream) are played as one.
+
+        -k frames         frames per buffer (default 1024)
+        -f format         16 bit integers (default) or 32 bit floats, if the implementation has
+                          AL_EXT_FLOAT32; otherwise playback falls back to 16 bit
+        -g gain           fixed gain; by default the stream is scaled by the largest magnitude
+                          it had so far, which is the normalization of the whole stream once
+                          its loudest part went by
+        -L file           instead of a device, play on an ALC_SOFT_loopback device (loopback.c)
+                          at the rate of the first stream, and write the rendered mix to file as
+                          complex chunks of a period each; as fast as the machine renders, with
+                          the same output on every run
+*/
+
+#define PLAY_BUFFERS 4
 
 void alinfo(void) {
         printf("General AL info:\n");
@@ -12,10 +37,107 @@ void alinfo(void) {
 
 }
 
+/* the stream on stdin, read piece by piece across the stream boundaries */
+typedef struct play_input_t {
+    FILE* fp;
+    float frequency_in_hz;  /* of the first stream, 0 before it */
+    size_t remaining;       /* complex samples left in the current stream */
+} play_input_t;
+
+/* reads up to max_frames real parts into out; stops at the end of the current stream if it already
+   has something, so a live stream is played as soon as a chunk is in. 0 at the end of the input */
+static size_t read_play_frames(play_input_t* input, float* out, size_t max_frames) {
+    size_t nr = 0;
+    while(nr < max_frames) {
+        if(input[0].remaining == 0) {
+            if(nr > 0) break;
+            simple_wav_t header;
+            if(!read_simple_wav_header(input[0].fp, &header)) break;
+            free(header.peaks);
+            if(input[0].frequency_in_hz == 0.0f) {
+                input[0].frequency_in_hz = header.frequency_in_hz;
+            } else if(header.frequency_in_hz != input[0].frequency_in_hz) {
+                die("sample rate changes within the stream!\n");
+            }
+            input[0].remaining = header.nr_sample_points/2;
+            continue;
+        }
+        float complex_sample[2];
+        read_simple_wav_samples(input[0].fp, complex_sample, 2);
+        out[nr++] = complex_sample[0];
+        input[0].remaining--;
+    }
+    return nr;
+}
+
+/* where the source plays: a device, which plays in its own time, or a loopback whose mix is
+   rendered a period at a time into a stream file */
+typedef struct play_output_t {
+    loopback_t* loopback;   /* NULL for a device */
+    FILE* fp;
+    size_t period_frames;
+    void* frames;           /* one rendered period */
+    float* amplitudes;      /* the same as a complex chunk */
+} play_output_t;
+
+/* lets the source play on: half a period of sleep on a device, a rendered period on a loopback */
+static void advance_playback(play_output_t* output, useconds_t period_usec) {
+    if(output[0].loopback == NULL) {
+        usleep(period_usec/2);
+        return;
+    }
+    loopback_render(output[0].loopback, output[0].frames, output[0].period_frames);
+    frames_to_mono(output[0].frames, output[0].period_frames, output[0].loopback[0].format, output[0].amplitudes, 2);
+    simple_wav_t chunk = {0};
+    chunk.frequency_in_hz = (float) output[0].loopback[0].rate;
+    chunk.nr_sample_points = 2*output[0].period_frames;
+    chunk.samples = output[0].amplitudes;
+    write_simple_wav(output[0].fp, chunk);
+}
+
+/* a buffer the source is done with; plays on until there is one */
+static ALuint wait_for_processed_buffer(ALuint source, play_output_t* output, useconds_t period_usec) {
+    while(true) {
+        ALint processed = 0;
+        alGetSourcei(source, AL_BUFFERS_PROCESSED, &processed);
+        if(processed > 0) {
+            ALuint buffer;
+            alSourceUnqueueBuffers(source, 1, &buffer);
+            return buffer;
+        }
+        advance_playback(output, period_usec);
+    }
+}
+
 int main(int argc, char** argv) {
+    size_t period_frames = 1024;
+    bool use_float = false;
+    float fixed_gain = 0.0f;
+    const char* dev_arg = NULL;
+    const char* loopback_path = NULL;
+    for(int i = 1; i < argc; i++) {
+        if(i+1 < argc && strcmp(argv[i], "-L") == 0) {
+            loopback_path = argv[++i];
+        } else if(i+1 < argc && strcmp(argv[i], "-k") == 0) {
+            period_frames = atol(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-g") == 0) {
+            fixed_gain = atof(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-f") == 0) {
+            i++;
+            if(strcmp(argv[i], "float") == 0) use_float = true;
+            else if(strcmp(argv[i], "16") == 0) use_float = false;
+            else die("sample format has to be 16 or float!\n");
+        } else if(dev_arg == NULL) {
+            dev_arg = argv[i];
+        } else {
+            die("usage: tty-snd-play [dev-nr | -L out-file] [-k frames] [-f 16|float] [-g gain]\n");
+        }
+    }
+    assert(period_frames > 0 && fixed_gain >= 0.0f);
+
     aladLoadAL();
 
-    if(argc < 2) {
+    if(dev_arg == NULL && loopback_path == NULL) {
         printf("Available output devices:\n");
         const char* capture_dev_string = alcGetString(NULL, ALC_DEVICE_SPECIFIER);
 
@@ -33,80 +155,141 @@ int main(int argc, char** argv) {
         printf("default: %s\n", default_dev);
 
     } else {
-        simple_wav_t float_form = read_simple_wav(stdin);
-
-        int dev_nr = atoi(argv[1]);
-        assert(dev_nr >= 0);
-
-        const char* capture_dev_string = alcGetString(NULL, ALC_DEVICE_SPECIFIER);
-
-        int num;
-        char** devs = split(capture_dev_string, strlen(capture_dev_string), '\0', &num);
-        assert(dev_nr < num);
-
-
-        fprintf(stderr, "chosen dev: %s\n", devs[dev_nr]);
-
-        ALCdevice* output = alcOpenDevice(devs[dev_nr]);
-
-        for(int i = 0; i < num; i++) {
-            free(devs[i]);
+        play_input_t input = {stdin, 0.0f, 0};
+        float* block = malloc(period_frames*sizeof(float));
+        int16_t* int_block = malloc(period_frames*sizeof(int16_t));
+
+        /* the loopback renders at the rate of the stream, so the first period is read before it is opened */
+        size_t nr = read_play_frames(&input, block, period_frames);
+
+        ALCdevice* output = NULL;
+        ALCcontext* context = NULL;
+        loopback_t loopback;
+        play_output_t play_output = {0};
+        if(loopback_path != NULL) {
+            if(nr == 0) die("no stream to play on the loopback!\n");
+            play_output.fp = fopen(loopback_path, "wb");
+            if(play_output.fp == NULL) die("could not open the loopback output!\n");
+            /* the mix is rendered in floats if the implementation can, it is converted to floats anyway */
+            sample_format_t render_format = {1, true};
+            if(!open_loopback(&loopback, (int) input.frequency_in_hz, render_format)) {
+                render_format.is_float = false;
+                if(!open_loopback(&loopback, (int) input.frequency_in_hz, render_format)) die("no loopback device!\n");
+            }
+            play_output.loopback = &loopback;
+            play_output.period_frames = period_frames;
+            play_output.frames = malloc(period_frames*sample_frame_size(render_format));
+            play_output.amplitudes = calloc(2*period_frames, sizeof(float));
+        } else {
+            int dev_nr = atoi(dev_arg);
+            assert(dev_nr >= 0);
+
+            const char* capture_dev_string = alcGetString(NULL, ALC_DEVICE_SPECIFIER);
+
+            int num;
+            char** devs = split(capture_dev_string, strlen(capture_dev_string), '\0', &num);
+            assert(dev_nr < num);
+
+
+            fprintf(stderr, "chosen dev: %s\n", devs[dev_nr]);
+
+            output = alcOpenDevice(devs[dev_nr]);
+
+            for(int i = 0; i < num; i++) {
+                free(devs[i]);
+            }
+
+            free(devs);
+
+            if(output == NULL) die("no output found");
+
+            int code = alcGetError(output);
+            if(code != ALC_NO_ERROR)  {
+                fprintf(stderr,"error %i\n", code);
+                exit(-1);
+            }
+
+            context = alcCreateContext(output, NULL);
+            if(context == NULL || !alcMakeContextCurrent(context)) die("could not create an AL context!\n");
         }
 
-        free(devs);
-
-
-        int code = alcGetError(output);
-        if(code != ALC_NO_ERROR)  {
-            fprintf(stderr,"error %i\n", code);
-            exit(-1);
+        if(use_float && !alIsExtensionPresent("AL_EXT_FLOAT32")) {
+            fprintf(stderr, "no float output (AL_EXT_FLOAT32), falling back to 16 bit\n");
+            use_float = false;
         }
+        sample_format_t format = {1, use_float};
+        ALenum al_format = al_sample_format(format);
 
-        if(output == NULL) die("no output found");
-
-        int new_len = float_form.nr_sample_points/2;
-
-        float* float_buffer = calloc(sizeof(float),new_len);
-        for(int i = 0; i < new_len; i++) {
-            float_buffer[i] = sqrt(float_form.samples[2*i]*float_form.samples[2*i]
-                            + float_form.samples[2*i+1]*float_form.samples[2*i+1]);
-        }
+        ALuint buffers[PLAY_BUFFERS], sourceid;
+        alGenBuffers(PLAY_BUFFERS, buffers);
+        alGenSources(1, &sourceid);
+        int nr_unused = PLAY_BUFFERS;
 
         float cur_max = 0.0f;
-        for(int i = 0; i < new_len; i++) {
-            if(fabs(float_buffer[i]) > cur_max)
-                cur_max = fabs(float_buffer[i]);
+        useconds_t period_usec = 0;
+
+        for(; nr > 0; nr = read_play_frames(&input, block, period_frames)) {
+            if(period_usec == 0) period_usec = (useconds_t)(1000000.0*period_frames/input.frequency_in_hz);
+
+            float gain = fixed_gain;
+            if(gain == 0.0f) {
+                for(size_t i = 0; i < nr; i++) {
+                    if(fabsf(block[i]) > cur_max) cur_max = fabsf(block[i]);
+                }
+                gain = (cur_max > 0.0f) ? 1.0f/cur_max : 0.0f;
+            }
+
+            const void* data = block;
+            size_t bytes = nr*sizeof(float);
+            if(use_float) {
+                for(size_t i = 0; i < nr; i++) {
+                    float x = block[i]*gain;
+                    block[i] = (x > 1.0f) ? 1.0f : (x < -1.0f) ? -1.0f : x;
+                }
+            } else {
+                for(size_t i = 0; i < nr; i++) {
+                    float x = block[i]*gain;
+                    x = (x > 1.0f) ? 1.0f : (x < -1.0f) ? -1.0f : x;
+                    int_block[i] = (int16_t) floorf(x*INT16_MAX);
+                }
+                data = int_block;
+                bytes = nr*sizeof(int16_t);
+            }
+
+            ALuint buffer = (nr_unused > 0) ? buffers[PLAY_BUFFERS - nr_unused--] : wait_for_processed_buffer(sourceid, &play_output, period_usec);
+            alBufferData(buffer, al_format, data, bytes, (ALsizei) floor(input.frequency_in_hz));
+            alSourceQueueBuffers(sourceid, 1, &buffer);
+
+            /* the first buffer, or the source ran dry because the input was late */
+            ALint state;
+            alGetSourcei(sourceid, AL_SOURCE_STATE, &state);
+            if(state != AL_PLAYING) alSourcePlay(sourceid);
         }
 
-        int16_t* int_buffer = calloc(sizeof(int16_t),new_len);
-        for(int i = 0; i < new_len; i++) {
-            int_buffer[i] = floor((float_buffer[i]/cur_max)*INT16_MAX);
+        /* let the queued buffers play out */
+        while(period_usec > 0) {
+            ALint state;
+            alGetSourcei(sourceid, AL_SOURCE_STATE, &state);
+            if(state != AL_PLAYING) break;
+            advance_playback(&play_output, period_usec);
         }
 
-        ALuint bufferid, sourceid;
-        alGenBuffers(1, &bufferid);
-
-        alBufferData(bufferid, AL_FORMAT_MONO16, int_buffer,  new_len, floor(float_form.frequency_in_hz));
-
-
-        alGenSources(1, &sourceid);
-
-        alSourcei(sourceid, AL_BUFFER, bufferid);
-        alSourcePlay(sourceid);
-
-
-        assert(usleep((new_len/float_form.frequency_in_hz)*1000000.0f) == 0);
-        while(true) {
-            assert(usleep(1000.0) == 0);
-            int code;
-            alGetSourcei(sourceid, AL_SOURCE_STATE, &code);
-            if(code != AL_PLAYING) break;
-        }
+        free(block);
+        free(int_block);
 
         alDeleteSources(1, &sourceid);
-        alDeleteBuffers(1, &bufferid);
-
-        alcCloseDevice(output);
+        alDeleteBuffers(PLAY_BUFFERS, buffers);
+
+        if(loopback_path != NULL) {
+            close_loopback(&loopback);
+            fclose(play_output.fp);
+            free(play_output.frames);
+            free(play_output.amplitudes);
+        } else {
+            alcMakeContextCurrent(NULL);
+            alcDestroyContext(context);
+            alcCloseDevice(output);
+        }
     }
 
     aladTerminate();
@@ -8,37 +8,30 @@
 */
 
 
-/*
- * formants, bws, is_selected needs to be at least order, and sound at least len long
- *  */
-
-void r_find_formants(double* sound, size_t len, double frequency, int order, int maxbw, int minformant, double* formants, double* bws, bool* is_selected) {
-	int i;
-	
-    if(order == 0)
-        order = round(frequency/1000.0)+3;
-    if(maxbw == 0)
-        maxbw = 600;
-    if(minformant == 0)
-        minformant = 200;
-
-    assert(sound != NULL && len > 1);
-
+/* number of points of the envelope in the fast mode; 1024 keeps the bins around 10 Hz at the usual rates */
+#define R_ENVELOPE_BINS 1024
 
 
+/* pre-emphasis (reading every stride-th sample, so interleaved streams need no copy), mean
+   removal and Hann window, then A(z) by the method of the engine (phonTools uses
+   autocorrelation); returns the order reached, A(z) is in engine[0].coeffs */
+static int r_lpc_coefficients(lpc_engine_t* engine, const float* samples, size_t stride, size_t len, double frequency, int order) {
+	int i;
+    double* sound = malloc(len*sizeof(double));
 
     int preemph_cutoff = 50;
     double preemph_coeff = -exp (-2.0 * M_PI * preemph_cutoff / frequency);
     // filter
-    double curr_value, old_value = sound[0];
-    double mean = sound[0];
+    double curr_value, old_value = samples[0];
+    double mean = sound[0] = samples[0];
     for(i = 1; i < len; i++) {
-        curr_value = sound[i];
+        curr_value = samples[i*stride];
         if (isnan(curr_value) || isnan(old_value)) {
             sound[i] = NAN;
         } else {
             sound[i] = curr_value + preemph_coeff*old_value;
         }
+        old_value = curr_value;
         /* mean calculation folded in so we don't have to traverse again*/
         mean += sound[i];
     }
@@ -50,59 +43,84 @@ void r_find_formants(double* sound, size_t len, double frequency, int order, int
         sound[i] *= 0.5 * (1 - cos ((2*M_PI*i)/(len-1)));
     }
 
-    double* r = calloc(order+1, sizeof(double));
-    for(int k = 0; k < order+1; k++) {
-        r[k] = 0.0;
-        for(i = 0; i < len-k; i++) {
-            r[k] += sound[i]*sound[i+k];
-        }
-    }
+    int reached = lpc_engine_analyze(engine, sound, len, order);
+    free(sound);
+    return reached;
+}
 
+/* phonTools' order for a sampling frequency, for callers that size the engine before analysing */
+int r_default_order(double frequency) {
+    return round(frequency/1000.0)+3;
+}
 
-    matrix_t w = create_matrix(order, order);
-    for(int i = 0; i < order; i++) {
-        for(int j = 0; j < order; j++) {
-            /* diagonals r[0], "Nebendiagonalen" r[1], etc.
-                example:
-                say order = 5
-
-                r[0]    r[1]    r[2]    r[3]    r[4]
-                r[1]    r[0]    r[1]    r[2]    r[3]
-                r[2]    r[1]    r[0]    r[1]    r[2]
-                r[3]    r[2]    r[1]    r[0]    r[1]
-                r[4]    r[3]    r[2]    r[1]    r[0]
-
-                */
-            set(w, i,j, r[abs(i-j)]);
-        }
-    }
+static void r_default_params(double frequency, int* order, int* maxbw, int* minformant) {
+    if(order[0] == 0)
+        order[0] = r_default_order(frequency);
+    if(maxbw[0] == 0)
+        maxbw[0] = 600;
+    if(minformant[0] == 0)
+        minformant[0] = 200;
+}
 
-    matrix_t w_inv = invert_matrix(w);
 
-    matrix_t b = create_matrix(order, 1);
-    for(int i = 0; i < order; i++) {
-        set(b, i, 0, -r[i+1]);
-    }
+/*
+ * formants, bws, is_selected needs to be at least order long; the sound is len samples, stride
+ * apart (2 for the real parts of a complex stream); the engine has to be created for at least
+ * that order and length. An order of 0 is r_default_order(frequency), which the engine then has
+ * to be created for
+ *  */
 
-    matrix_t m_coeffs = matrix_multiply(b, w_inv);
+void r_find_formants(lpc_engine_t* engine, const float* samples, size_t stride, size_t len, double frequency, int order, int maxbw, int minformant, double* formants, double* bws, bool* is_selected) {
+    r_default_params(frequency, &order, &maxbw, &minformant);
+    assert(samples != NULL && len > 1 && order <= engine[0].max_order);
+
+    int reached = r_lpc_coefficients(engine, samples, stride, len, frequency, order);
+
+    /* the roots of A(z) are those of z^order A(z), whose coefficients in ascending powers are a reversed */
+    double* rev_coeffs = calloc(reached+1, sizeof(double));
+    lpc_engine_root_polynomial(engine, rev_coeffs);
 
-    double* rev_coeffs = calloc(order+1, sizeof(double));
-    for(int i = 0; i < order; i++) {
-        rev_coeffs[order-i] = get(m_coeffs,(order-1)-i,0);
-    }
-    rev_coeffs[0] = 1.0;
-    
     double* roots = calloc(2*order, sizeof(double));
     double* working_mat = calloc(order*order, sizeof(double));
-    poly_complex_solve(rev_coeffs, order+1, roots, working_mat);
+    poly_solve_status_t status = (reached > 0) ? poly_complex_solve_status(rev_coeffs, reached+1, roots, working_mat) : POLY_SOLVE_BAD_DEGREE;
     free(working_mat);
     free(rev_coeffs);
     
     
     for(int i = 0; i < order; i++) {
-		formants[i] = atan2(roots[2*i+1], roots[2*i]) * (frequency/2*M_PI);
+        if(status != POLY_SOLVE_OK || i >= reached) {
+            formants[i] = bws[i] = 0.0;
+            is_selected[i] = false;
+            continue;
+        }
+		formants[i] = atan2(roots[2*i+1], roots[2*i]) * (frequency/(2*M_PI));
+		formants[i] = round(formants[i]*100.0)/100.0; /* to two decimal digits */
+		bws[i] = -(frequency/M_PI)*0.5*log(roots[2*i]*roots[2*i] + roots[2*i+1]*roots[2*i+1]); /* -fs/pi ln|z| */
+		is_selected[i] = (bws[i] < maxbw && formants[i] > minformant && formants[i] < frequency/2);
+	}
+    free(roots);
+}
+
+/*
+ * same output as r_find_formants, but the formants are the peaks of the LPC envelope instead of
+ * the roots of A(z); only the first "number found" entries are used, the rest are 0 and unselected
+ *  */
+void r_find_formants_fft(lpc_engine_t* engine, const float* samples, size_t stride, size_t len, double frequency, int order, int maxbw, int minformant, double* formants, double* bws, bool* is_selected) {
+    r_default_params(frequency, &order, &maxbw, &minformant);
+    assert(samples != NULL && len > 1 && order <= engine[0].max_order);
+
+    int reached = r_lpc_coefficients(engine, samples, stride, len, frequency, order);
+    double* work = malloc(lpc_envelope_work_size(R_ENVELOPE_BINS)*sizeof(double));
+    size_t nr_found = lpc_envelope_formants_d(engine[0].coeffs, reached, frequency, R_ENVELOPE_BINS, formants, bws, order, work);
+    free(work);
+
+    for(int i = 0; i < order; i++) {
+        if(i >= nr_found) {
+            formants[i] = bws[i] = 0.0;
+            is_selected[i] = false;
+            continue;
+        }
 		formants[i] = round(formants[i]*100.0)/100.0; /* to two decimal digits */
-		bws[i] = -(frequency/M_PI)*log(roots[2*i]*roots[2*i] + roots[2*i+1]*roots[2*i+1]);
 		is_selected[i] = (bws[i] < maxbw && formants[i] > minformant && formants[i] < frequency/2);
 	}
 }
@@ -0,0 +1,145 @@
+#include "common.h"
+
+/*
+ * Rolloff velocity of the peaks in a spectrum.
+ *
+ * For every peak we need the minimum between the end of its interval and the start of the
+ * next peak, and then the closest point before that minimum which still reaches 80% of the
+ * peak height. Both are range queries over the same array, so we build a segment tree of
+ * argmin / argmax indices once per spectrum (or per STFT frame, reusing the allocation)
+ * and answer every peak in O(log n) instead of rescanning the spectrum.
+ */
+
+#define RANGE_QUERY_NONE UINT32_MAX
+
+range_query_t create_range_query(size_t max_len) {
+    assert(max_len > 0 && max_len < RANGE_QUERY_NONE);
+    range_query_t rq = {0};
+    rq.size = 1;
+    while(rq.size < max_len) rq.size <<= 1;
+    rq.min_tree = malloc(2*rq.size*sizeof(uint32_t));
+    rq.max_tree = malloc(2*rq.size*sizeof(uint32_t));
+    if(rq.min_tree == NULL || rq.max_tree == NULL) die("out of memory for range query tree!\n");
+    return rq;
+}
+
+void destroy_range_query(range_query_t* rq) {
+    free(rq[0].min_tree);
+    free(rq[0].max_tree);
+    rq[0].min_tree = rq[0].max_tree = NULL;
+    rq[0].data = NULL;
+    rq[0].len = rq[0].size = 0;
+}
+
+/* ties go to the leftmost minimum and to the rightmost maximum, like the old linear scans */
+static uint32_t pick_min(const float* data, uint32_t a, uint32_t b) {
+    if(a == RANGE_QUERY_NONE) return b;
+    if(b == RANGE_QUERY_NONE) return a;
+    return (data[b] < data[a]) ? b : a;
+}
+static uint32_t pick_max(const float* data, uint32_t a, uint32_t b) {
+    if(a == RANGE_QUERY_NONE) return b;
+    if(b == RANGE_QUERY_NONE) return a;
+    return (data[a] > data[b]) ? a : b;
+}
+
+void build_range_query(range_query_t* rq, const float* data, size_t len) {
+    assert(len > 0 && len <= rq[0].size);
+    rq[0].data = data;
+    rq[0].len = len;
+    size_t size = rq[0].size;
+    for(size_t i = 0; i < size; i++) {
+        uint32_t leaf = (i < len) ? (uint32_t) i : RANGE_QUERY_NONE;
+        rq[0].min_tree[size+i] = leaf;
+        rq[0].max_tree[size+i] = leaf;
+    }
+    for(size_t node = size-1; node > 0; node--) {
+        rq[0].min_tree[node] = pick_min(data, rq[0].min_tree[2*node], rq[0].min_tree[2*node+1]);
+        rq[0].max_tree[node] = pick_max(data, rq[0].max_tree[2*node], rq[0].max_tree[2*node+1]);
+    }
+}
+
+/* bounds are inclusive */
+size_t range_argmin(const range_query_t* rq, size_t lo, size_t hi) {
+    assert(lo <= hi && hi < rq[0].len);
+    uint32_t left = RANGE_QUERY_NONE, right = RANGE_QUERY_NONE;
+    for(size_t l = lo + rq[0].size, r = hi + rq[0].size + 1; l < r; l >>= 1, r >>= 1) {
+        if(l & 1) left = pick_min(rq[0].data, left, rq[0].min_tree[l++]);
+        if(r & 1) right = pick_min(rq[0].data, rq[0].min_tree[--r], right);
+    }
+    return pick_min(rq[0].data, left, right);
+}
+size_t range_argmax(const range_query_t* rq, size_t lo, size_t hi) {
+    assert(lo <= hi && hi < rq[0].len);
+    uint32_t left = RANGE_QUERY_NONE, right = RANGE_QUERY_NONE;
+    for(size_t l = lo + rq[0].size, r = hi + rq[0].size + 1; l < r; l >>= 1, r >>= 1) {
+        if(l & 1) left = pick_max(rq[0].data, left, rq[0].max_tree[l++]);
+        if(r & 1) right = pick_max(rq[0].data, rq[0].max_tree[--r], right);
+    }
+    return pick_max(rq[0].data, left, right);
+}
+
+static uint32_t last_above_in_node(const range_query_t* rq, size_t node, size_t node_lo, size_t node_hi, size_t lo, size_t hi, float value) {
+    if(node_hi < lo || hi < node_lo) return RANGE_QUERY_NONE;
+    uint32_t max_index = rq[0].max_tree[node];
+    if(max_index == RANGE_QUERY_NONE || !(rq[0].data[max_index] > value)) return RANGE_QUERY_NONE;
+    if(node >= rq[0].size) return max_index; /* leaf */
+    size_t mid = node_lo + (node_hi - node_lo)/2;
+    uint32_t found = last_above_in_node(rq, 2*node+1, mid+1, node_hi, lo, hi, value);
+    if(found != RANGE_QUERY_NONE) return found;
+    return last_above_in_node(rq, 2*node, node_lo, mid, lo, hi, value);
+}
+
+/* finds the largest index in [lo,hi] whose value is strictly above the given one */
+bool range_last_above(const range_query_t* rq, size_t lo, size_t hi, float value, size_t* out_index) {
+    assert(lo <= hi && hi < rq[0].len);
+    uint32_t found = last_above_in_node(rq, 1, 0, rq[0].size-1, lo, hi, value);
+    if(found == RANGE_QUERY_NONE) return false;
+    if(out_index != NULL) out_index[0] = found;
+    return true;
+}
+
+
+
+/* peaks have to be sorted by frequency, and rq has to be built over the spectrum they were found in */
+void compute_rolloff_velocities(const range_query_t* rq, peak_t* peaks, size_t nr_peaks) {
+    const float* data = rq[0].data;
+    size_t last_index = rq[0].len - 1;
+
+    for(size_t i = 0; i < nr_peaks; i++) {
+        size_t upper_index = peaks[i].underlying_interval.upper_index;
+        size_t bound = (i != nr_peaks-1) ? peaks[i+1].underlying_interval.lower_index : last_index;
+        if(bound > last_index) bound = last_index;
+
+        if(upper_index+1 > bound) {
+            /* no room to roll off before the next peak (or the end of the spectrum) */
+            peaks[i].rolloff_v = 0.0f;
+            peaks[i].min_index = upper_index;
+            continue;
+        }
+
+        size_t min_index = range_argmin(rq, upper_index+1, bound);
+        float min_value = data[min_index];
+        float criterion_height = min_value + 0.8f*(peaks[i].height - min_value);
+
+        /* walking back from one past the minimum, the first point above the criterion; if
+           there is none, the highest point on the way back (on ties the minimum itself,
+           then the point after it, then the rightmost one, as the old backwards scan did) */
+        size_t search_end = (min_index+1 <= last_index) ? min_index+1 : last_index;
+        size_t find_index;
+        if(!range_last_above(rq, upper_index+1, search_end, criterion_height, &find_index)) {
+            find_index = range_argmax(rq, upper_index+1, min_index);
+            if(search_end != min_index) {
+                float next_value = data[search_end];
+                if(next_value > data[find_index] || (next_value == data[find_index] && find_index != min_index))
+                    find_index = search_end;
+            }
+        }
+        float find_value = data[find_index];
+
+        int delta_x = (int) upper_index - (int) find_index;
+        float delta_y = peaks[i].height - find_value;
+        peaks[i].rolloff_v = -delta_y/delta_x;
+        peaks[i].min_index = min_index;
+    }
+}
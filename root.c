@@ -19,42 +19,31 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
-#include <stddef.h>
-#include <math.h>
+#include "common.h"
 
-void die(const char* str);
 
 #define MY_DBL_EPSILON        2.2204460492503131e-16
 /* defines inlined row-major matrix access */
 #define MAT(i,j) working_matrix[(i)*len+j]
 
-/** finds the complex roots of  = 0
- * @param polynomial_coefficients  must point to an array of at least nr_of_terms coefficient values, interpreted as the real coefficients of the polynomial, and not changed
- * @param polynomial_roots         must point to an array of at least 2*(nr_of_terms-1) doubles that can be written to, will contain the real and complex values of the roots in alternating order
- * @param working_matrix           must point to an array of at least (nr_of_terms - 1)*(nr_of_terms - 1) doubles that can be written to, will include temporary working order, can be discarded
-*/
-void poly_complex_solve(const double *polynomial_coefficients, size_t nr_of_terms, double* polynomial_roots, double* working_matrix) {
-    if (nr_of_terms == 0) {
-        die("number of terms must be a positive integer"); /* EINVAL */
-    }
-    if (nr_of_terms == 1) {
-        die("cannot solve for only one term"); /* EINVAL */
-    }
-    if (polynomial_coefficients[nr_of_terms - 1] == 0) {
-        die("leading term of polynomial must be non-zero"); /* EINVAL */
-    }
-
-    size_t len = nr_of_terms - 1;
+/* polynomials per job of poly_complex_solve_batch. The batching is about the memory layout and
+   the threads: the polynomials are read in place from their structure of arrays a block at a
+   time, but every one is then balanced and QR iterated on its own, in scalar code */
+#define POLY_BATCH_BLOCK 4
 
-    /* setup the companion working matrix: */
+/* sets up the companion matrix from its last column, the already normalized -c_i/c_n */
+static void setup_companion_matrix(double* working_matrix, size_t len, const double* last_column, size_t column_stride) {
     for (int i = 0; i < len; i++)
         for (int j = 0; j < len; j++)
             MAT(i, j) = 0.0;
     for (int i = 1; i < len; i++)
         MAT(i, i - 1) = 1.0;
     for (int i = 0; i < len; i++)
-        MAT(i, len - 1) = -polynomial_coefficients[i] / polynomial_coefficients[nr_of_terms-1];
+        MAT(i, len - 1) = last_column[i*column_stride];
+}
 
+/* balances the companion matrix and runs the QR algorithm on it, roots as in poly_complex_solve */
+static poly_solve_status_t solve_companion_matrix(double* working_matrix, size_t len, double* polynomial_roots) {
     /* balance the companion working matrix: */
     int not_converged = 1;
     while (not_converged) {
@@ -141,7 +130,7 @@ void poly_complex_solve(const double *polynomial_coefficients, size_t nr_of_term
             polynomial_roots[2*(n-1)+1] = 0;
             n--;
             if (n == 0)
-                return; /* SUCCESS! */
+                return POLY_SOLVE_OK; /* SUCCESS! */
             iterations = 0;
             continue; /*goto next_iteration;*/
         }
@@ -168,14 +157,14 @@ void poly_complex_solve(const double *polynomial_coefficients, size_t nr_of_term
             }
             n -= 2;
             if (n == 0)
-                return; /* SUCCESS! */
+                return POLY_SOLVE_OK; /* SUCCESS! */
             iterations = 0;
             continue; /*goto next_iteration;*/
         }
         /* No more roots found yet, do another iteration */
         if (iterations == 120) { /* increased from 30 to 120 */
             /* too many iterations - give up! */
-            die("root solving qr method failed to converge"); /* EFAILED */
+            return POLY_SOLVE_NO_CONVERGENCE; /* EFAILED */
         }
         if (iterations % 10 == 0 && iterations > 0) {
             /* use an exceptional shift */
@@ -285,3 +274,124 @@ void poly_complex_solve(const double *polynomial_coefficients, size_t nr_of_term
         }
     }
 }
+
+
+
+/** finds the complex roots of  = 0, reporting failures instead of exiting
+ * @param polynomial_coefficients  must point to an array of at least nr_of_terms coefficient values, interpreted as the real coefficients of the polynomial (lowest power first), and not changed
+ * @param polynomial_roots         must point to an array of at least 2*(nr_of_terms-1) doubles that can be written to, will contain the real and complex values of the roots in alternating order
+ * @param working_matrix           must point to an array of at least (nr_of_terms - 1)*(nr_of_terms - 1) doubles that can be written to, will include temporary working order, can be discarded
+*/
+poly_solve_status_t poly_complex_solve_status(const double *polynomial_coefficients, size_t nr_of_terms, double* polynomial_roots, double* working_matrix) {
+    if (nr_of_terms < 2) {
+        return POLY_SOLVE_BAD_DEGREE; /* EINVAL */
+    }
+    if (polynomial_coefficients[nr_of_terms - 1] == 0) {
+        return POLY_SOLVE_ZERO_LEADING_TERM; /* EINVAL */
+    }
+
+    size_t len = nr_of_terms - 1;
+    double* last_column = polynomial_roots; /* free until the QR writes the roots */
+    for (int i = 0; i < len; i++)
+        last_column[i] = -polynomial_coefficients[i] / polynomial_coefficients[nr_of_terms-1];
+    setup_companion_matrix(working_matrix, len, last_column, 1);
+
+    return solve_companion_matrix(working_matrix, len, polynomial_roots);
+}
+
+/** like poly_complex_solve_status, but exits on failure */
+void poly_complex_solve(const double *polynomial_coefficients, size_t nr_of_terms, double* polynomial_roots, double* working_matrix) {
+    switch (poly_complex_solve_status(polynomial_coefficients, nr_of_terms, polynomial_roots, working_matrix)) {
+        case POLY_SOLVE_OK:
+            return;
+        case POLY_SOLVE_BAD_DEGREE:
+            die("polynomial needs at least two terms");
+            break;
+        case POLY_SOLVE_ZERO_LEADING_TERM:
+            die("leading term of polynomial must be non-zero");
+            break;
+        case POLY_SOLVE_NO_CONVERGENCE:
+            die("root solving qr method failed to converge");
+            break;
+    }
+}
+
+
+
+typedef struct poly_batch_t {
+    const double* coefficients;
+    size_t nr_polys, nr_of_terms;
+    double* roots;
+    poly_solve_status_t* status;
+    double* work;
+} poly_batch_t;
+
+size_t poly_complex_solve_batch_work_size(size_t nr_of_terms, int nr_threads) {
+    size_t len = nr_of_terms - 1;
+    if (nr_threads < 1) nr_threads = 1; /* as parallel_for, which still runs one thread */
+    /* per thread: the matrix, the normalized last columns of one block and the roots of one polynomial */
+    return nr_threads * (len*len + POLY_BATCH_BLOCK*len + 2*len);
+}
+
+/* -c_i/c_n for a block of polynomials side by side */
+static void normalize_block(const double* coefficients, size_t nr_polys, size_t nr_of_terms, size_t first, double* columns) {
+    size_t len = nr_of_terms - 1;
+    const double* leading = &coefficients[len*nr_polys + first];
+    for (size_t i = 0; i < len; i++) {
+        const double* row = &coefficients[i*nr_polys + first];
+        double* out = &columns[i*POLY_BATCH_BLOCK];
+        for (size_t lane = 0; lane < POLY_BATCH_BLOCK && first+lane < nr_polys; lane++) {
+            out[lane] = -row[lane] / leading[lane];
+        }
+    }
+}
+
+static void solve_block(void* ctx, int thread_nr, size_t job_nr) {
+    poly_batch_t* batch = ctx;
+    size_t nr_polys = batch[0].nr_polys;
+    size_t len = batch[0].nr_of_terms - 1;
+    double* working_matrix = &batch[0].work[thread_nr * (len*len + POLY_BATCH_BLOCK*len + 2*len)];
+    double* columns = &working_matrix[len*len];
+    double* roots = &columns[POLY_BATCH_BLOCK*len];
+
+    size_t first = job_nr*POLY_BATCH_BLOCK;
+    normalize_block(batch[0].coefficients, nr_polys, batch[0].nr_of_terms, first, columns);
+
+    for (size_t lane = 0; lane < POLY_BATCH_BLOCK && first+lane < nr_polys; lane++) {
+        size_t m = first+lane;
+        poly_solve_status_t status;
+        if (batch[0].coefficients[len*nr_polys + m] == 0) {
+            status = POLY_SOLVE_ZERO_LEADING_TERM;
+        } else {
+            setup_companion_matrix(working_matrix, len, &columns[lane], POLY_BATCH_BLOCK);
+            status = solve_companion_matrix(working_matrix, len, roots);
+        }
+        for (size_t j = 0; j < 2*len; j++) {
+            batch[0].roots[j*nr_polys + m] = (status == POLY_SOLVE_OK) ? roots[j] : NAN;
+        }
+        batch[0].status[m] = status;
+    }
+}
+
+/** finds the roots of nr_polys polynomials of the same degree at once, blocks of them on nr_threads threads
+ * @param coefficients  structure of arrays: coefficient i (lowest power first) of polynomial m is coefficients[i*nr_polys + m]
+ * @param roots         2*(nr_of_terms-1) rows of nr_polys doubles: the real part of root j of polynomial m is roots[2*j*nr_polys + m],
+ *                      the imaginary part roots[(2*j+1)*nr_polys + m]; NAN for polynomials that could not be solved
+ * @param status        nr_polys entries, POLY_SOLVE_OK or why that polynomial failed
+ * @param work          at least poly_complex_solve_batch_work_size(nr_of_terms, nr_threads) doubles
+ * @return              the number of polynomials that were solved
+*/
+size_t poly_complex_solve_batch(const double* coefficients, size_t nr_polys, size_t nr_of_terms, double* roots, poly_solve_status_t* status, double* work, int nr_threads) {
+    if (nr_of_terms < 2) {
+        for (size_t m = 0; m < nr_polys; m++) status[m] = POLY_SOLVE_BAD_DEGREE;
+        return 0;
+    }
+    poly_batch_t batch = {coefficients, nr_polys, nr_of_terms, roots, status, work};
+    parallel_for((nr_polys + POLY_BATCH_BLOCK-1)/POLY_BATCH_BLOCK, nr_threads, solve_block, &batch);
+
+    size_t nr_solved = 0;
+    for (size_t m = 0; m < nr_polys; m++) {
+        if (status[m] == POLY_SOLVE_OK) nr_solved++;
+    }
+    return nr_solved;
+}
@@ -226,15 +226,19 @@ void write_simple_wav(FILE* fp, simple_wav_t data) {
     for(int i = 0; i < data.nr_sample_points; i++) {
         write_f32be(fp, data.samples[i]);
     }
-
-    fprintf(stderr, "out nr = %zu, blk = %zu\n", data.nr_sample_points, ssnd_block_size);
 }
 
-simple_wav_t read_simple_wav(FILE* fp) {
+/* reads the header of the next stream up to the sample data: frequency, nr_sample_points and the
+   peaks, samples stays NULL. Streams can follow each other in one file, as the chunks of
+   tty-snd-mic-src stream do; at a clean end of file before the next header this returns false */
+bool read_simple_wav_header(FILE* fp, simple_wav_t* header_out) {
     simple_wav_t ret = {0};
     int32_t size_to_read;
 
-    check_input(fp, "FORM");
+    int first = fgetc(fp);
+    if(first == EOF) return false;
+    assert(first == 'F');
+    check_input(fp, "ORM");
     size_to_read = read_i32be(fp);
     assert(size_to_read > 0);
     check_input(fp, "AIFC");                        size_to_read -= 4;
@@ -250,7 +254,6 @@ simple_wav_t read_simple_wav(FILE* fp) {
     ret.nr_sample_points = read_i32be(fp);          size_to_read -= 4;
 
     size_t expected_size = sizeof(float)*ret.nr_sample_points+8;
-    fprintf(stderr, "in nr = %zu, blk = %zu\n", ret.nr_sample_points, expected_size);
 
     assert(read_i16be(fp) == 32);                   size_to_read -= 2;
     char extended[10];
@@ -270,27 +273,73 @@ simple_wav_t read_simple_wav(FILE* fp) {
     fread(appdata_buf, 1, appdata_size, fp);         size_to_read -= appdata_size;
 
     if(appdata_size == strlen(appdata_basic)) {
-        assert(strcmp(appdata_basic, appdata_buf) == 0);
+        assert(strncmp(appdata_basic, appdata_buf, appdata_size) == 0);
     } else {
         fprintf(stderr, "appdata_size=%i\n", appdata_size);
         assert(appdata_size > strlen(appdata_peaks_intro));
         assert(strncmp(appdata_buf, appdata_peaks_intro, strlen(appdata_peaks_intro)) == 0);
         parse_peak_structs(&appdata_buf[strlen(appdata_peaks_intro)], appdata_size-strlen(appdata_peaks_intro), &ret.peaks, &ret.nr_peaks);
     }
+    free(appdata_buf);
 
 
     check_input(fp, "SSND");                                            size_to_read -= 4;
     assert(read_i32be(fp) == expected_size);    size_to_read -= 4;
     assert(read_i32be(fp) == 0);                   size_to_read -= 4;
     assert(read_i32be(fp) == 0);                   size_to_read -= 4;
-    ret.samples = calloc(ret.nr_sample_points, sizeof(float));
-    /*fread(ret.samples, sizeof(float), ret.nr_sample_points, fp);*/
-    for(int i = 0; i < ret.nr_sample_points; i++) {
-        ret.samples[i] =  read_f32be(fp);
-        size_to_read -= 4;
+    assert(size_to_read == sizeof(float)*ret.nr_sample_points);
+
+    header_out[0] = ret;
+    return true;
+}
+
+/* the next nr floats of the sample data; a stream's data can be read in as many pieces as wanted */
+void read_simple_wav_samples(FILE* fp, float* samples, size_t nr) {
+    /*fread(samples, sizeof(float), nr, fp);*/
+    for(size_t i = 0; i < nr; i++) {
+        samples[i] = read_f32be(fp);
     }
-    assert(size_to_read == 0);
-    return ret;
 }
 
+/* up to max_frames real parts of the consecutive streams on fp, read across the stream boundaries:
+   remaining is what is left of the current stream and frequency_in_hz the rate of the first one,
+   both 0 to start; the following streams have to keep that rate. 0 at the end of the file */
+size_t read_stream_real_parts(FILE* fp, size_t* remaining, float* frequency_in_hz, float* out, size_t max_frames) {
+    size_t nr = 0;
+    while(nr < max_frames) {
+        if(remaining[0] == 0) {
+            simple_wav_t header;
+            if(!read_simple_wav_header(fp, &header)) break;
+            free(header.peaks);
+            if(frequency_in_hz[0] == 0.0f) frequency_in_hz[0] = header.frequency_in_hz;
+            else if(header.frequency_in_hz != frequency_in_hz[0]) die("sample rate changes within the stream!\n");
+            remaining[0] = header.nr_sample_points/2;
+            continue;
+        }
+        size_t block = max_frames - nr;
+        if(block > remaining[0]) block = remaining[0];
+        for(size_t i = 0; i < block; i++) {
+            out[nr+i] = read_f32be(fp);
+            read_f32be(fp);
+        }
+        nr += block;
+        remaining[0] -= block;
+    }
+    return nr;
+}
+
+/* the next stream of the file, false at a clean end of file */
+bool try_read_simple_wav(FILE* fp, simple_wav_t* wav_out) {
+    simple_wav_t ret;
+    if(!read_simple_wav_header(fp, &ret)) return false;
+    ret.samples = calloc(ret.nr_sample_points, sizeof(float));
+    read_simple_wav_samples(fp, ret.samples, ret.nr_sample_points);
+    wav_out[0] = ret;
+    return true;
+}
 
+simple_wav_t read_simple_wav(FILE* fp) {
+    simple_wav_t ret;
+    if(!try_read_simple_wav(fp, &ret)) die("no sound stream in the input!\n");
+    return ret;
+}
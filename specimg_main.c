@@ -0,0 +1,275 @@
+#include "common.h"
+
+/* tty-snd-specimg:
+        renders a series of spectra into a BMP spectrogram: a row per spectrum from top to bottom,
+        frequency on log spaced columns from left to right, the magnitude in the colors of
+        tty-snd-waterfall
+
+        tty-snd-specimg out.bmp [-w columns] [-l min-Hz] [-u max-Hz] [-d range-dB] [-F]
+                                [-T fft-length hop] [-j threads] [-D dpi]
+
+        -w columns        width of the image (default: a column per bin in the range, at most 1024)
+        -l, -u Hz         frequency range (default 50 Hz to half the sample rate)
+        -d dB             dynamic range below 0 dB (default 100)
+        -F                0 dB is a sine of amplitude 1, as tty-snd-mic-src records it; by default
+                          it is the loudest bin of the first strip, so streams in any scale (such as
+                          the 16 bit range of tty-snd-wav) come out the same
+        -T frames hop     the input is a sound stream: run a Hann windowed FFT of fft-length every
+                          hop frames over its real parts. Without -T every stream on stdin is one
+                          spectrum, as tty-snd-fft writes it
+        -j threads        (default: one per core)
+        -D dpi            resolution written into the file (default 72)
+
+        The input is taken in strips of SPECIMG_STRIP_ROWS rows. The rows of a strip are rendered
+        in parallel, in tiles of SPECIMG_TILE_ROWS rows (threads.c), through column bins and a
+        color map computed once, and the strip is written to the file (bmp.c) before the next one
+        is read, so memory stays a strip for an input of any length.
+*/
+
+#define SPECIMG_STRIP_ROWS 256
+#define SPECIMG_TILE_ROWS 16
+#define SPECIMG_LEVELS 256
+
+typedef struct specimg_t {
+    int columns;
+    double min_hz, max_hz, range_db;
+    size_t fft_len, hop;        /* 0 for an input of spectra */
+    size_t nr_bins;
+    size_t* column_bins;        /* columns+1 bin boundaries */
+    float power_scale;          /* a power times this is 1 at 0 dB */
+    uint8_t colors[SPECIMG_LEVELS][3];  /* blue, green, red as in the file */
+
+    /* the strip */
+    size_t nr_rows;
+    float* power;               /* nr_rows spectra of nr_bins, for an input of spectra */
+    float* samples;             /* (SPECIMG_STRIP_ROWS-1)*hop + fft_len samples, with -T */
+    float* window;
+    uint8_t* rows;              /* in the layout of the file */
+    size_t row_size;
+
+    /* per thread, with -T */
+    float* spectrum[MAX_THREADS];
+    float* work[MAX_THREADS];
+    float* thread_power[MAX_THREADS];
+    float* tile_max;            /* the loudest bin per tile of the first strip */
+} specimg_t;
+
+/* the power spectrum of row r of the strip */
+static const float* specimg_row_power(specimg_t* img, int thread_nr, size_t r) {
+    if(img[0].fft_len == 0) return &img[0].power[r*img[0].nr_bins];
+
+    size_t fft_len = img[0].fft_len;
+    const float* samples = &img[0].samples[r*img[0].hop];
+    float* spectrum = img[0].spectrum[thread_nr];
+    float* power = img[0].thread_power[thread_nr];
+    for(size_t i = 0; i < fft_len; i++) {
+        spectrum[2*i] = img[0].window[i]*samples[i];
+        spectrum[2*i+1] = 0.0f;
+    }
+    fft_power_of_two_batch_f(spectrum, spectrum, 2*fft_len, 1, false, img[0].work[thread_nr]);
+    for(size_t k = 0; k < img[0].nr_bins; k++) {
+        power[k] = spectrum[2*k]*spectrum[2*k] + spectrum[2*k+1]*spectrum[2*k+1];
+    }
+    return power;
+}
+
+static void measure_specimg_tile(void* ctx, int thread_nr, size_t tile_nr) {
+    specimg_t* img = ctx;
+    size_t first = tile_nr*SPECIMG_TILE_ROWS;
+    size_t last = first + SPECIMG_TILE_ROWS;
+    if(last > img[0].nr_rows) last = img[0].nr_rows;
+
+    float max = 0.0f;
+    for(size_t r = first; r < last; r++) {
+        const float* power = specimg_row_power(img, thread_nr, r);
+        for(size_t k = img[0].column_bins[0]; k < column_bin_end(img[0].column_bins, img[0].columns-1); k++) {
+            if(power[k] > max) max = power[k];
+        }
+    }
+    img[0].tile_max[tile_nr] = max;
+}
+
+static void render_specimg_tile(void* ctx, int thread_nr, size_t tile_nr) {
+    specimg_t* img = ctx;
+    size_t first = tile_nr*SPECIMG_TILE_ROWS;
+    size_t last = first + SPECIMG_TILE_ROWS;
+    if(last > img[0].nr_rows) last = img[0].nr_rows;
+
+    for(size_t r = first; r < last; r++) {
+        const float* power = specimg_row_power(img, thread_nr, r);
+        uint8_t* row = &img[0].rows[r*img[0].row_size];
+        for(int c = 0; c < img[0].columns; c++) {
+            float max = 0.0f;
+            for(size_t k = img[0].column_bins[c]; k < column_bin_end(img[0].column_bins, c); k++) {
+                if(power[k] > max) max = power[k];
+            }
+            float db = 10.0f*log10f(max*img[0].power_scale + 1e-30f);
+            long level = lroundf((db + img[0].range_db)/img[0].range_db*(SPECIMG_LEVELS-1));
+            level = (level < 0) ? 0 : (level > SPECIMG_LEVELS-1) ? SPECIMG_LEVELS-1 : level;
+            memcpy(&row[3*c], img[0].colors[level], 3);
+        }
+    }
+}
+
+/* reads the next strip; returns its number of rows, 0 at the end of the input */
+static size_t read_specimg_strip(specimg_t* img, size_t* remaining, float* rate) {
+    size_t nr_rows = 0;
+    if(img[0].fft_len == 0) {
+        simple_wav_t spectrum;
+        while(nr_rows < SPECIMG_STRIP_ROWS && try_read_simple_wav(stdin, &spectrum)) {
+            size_t len = spectrum.nr_sample_points/2;
+            if(len < 2) die("a spectrum needs at least two bins!\n");
+            if(img[0].nr_bins == 0) {
+                img[0].nr_bins = len/2+1;
+                rate[0] = spectrum.frequency_in_hz;
+                img[0].power = malloc(SPECIMG_STRIP_ROWS*img[0].nr_bins*sizeof(float));
+                /* tty-snd-fft does not window: a full scale sine has the magnitude len/2 */
+                img[0].power_scale = 4.0f/((float) len*len);
+            } else if(len/2+1 != img[0].nr_bins || spectrum.frequency_in_hz != rate[0]) {
+                die("the spectra have to keep their size and rate!\n");
+            }
+            float* power = &img[0].power[nr_rows*img[0].nr_bins];
+            for(size_t k = 0; k < img[0].nr_bins; k++) {
+                power[k] = spectrum.samples[2*k]*spectrum.samples[2*k] + spectrum.samples[2*k+1]*spectrum.samples[2*k+1];
+            }
+            free(spectrum.samples);
+            free(spectrum.peaks);
+            nr_rows++;
+        }
+    } else {
+        /* the samples of the first row of the strip are the last window of the previous strip moved on by a hop */
+        size_t overlap = img[0].fft_len - img[0].hop;
+        while(nr_rows < SPECIMG_STRIP_ROWS) {
+            float* dest = &img[0].samples[overlap + nr_rows*img[0].hop];
+            if(read_stream_real_parts(stdin, remaining, rate, dest, img[0].hop) < img[0].hop) break;
+            nr_rows++;
+        }
+    }
+    img[0].nr_rows = nr_rows;
+    return nr_rows;
+}
+
+int main(int argc, char** argv) {
+    const char* file_name = NULL;
+    int columns = 0;
+    double min_hz = 50.0, max_hz = 0.0, range_db = 100.0;
+    size_t fft_len = 0, hop = 0;
+    int nr_threads = default_thread_count();
+    float dpi = 72.0f;
+    bool full_scale = false;
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-F") == 0) {
+            full_scale = true;
+        } else if(i+1 < argc && strcmp(argv[i], "-w") == 0) {
+            columns = atoi(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-l") == 0) {
+            min_hz = atof(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-u") == 0) {
+            max_hz = atof(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-d") == 0) {
+            range_db = atof(argv[++i]);
+        } else if(i+2 < argc && strcmp(argv[i], "-T") == 0) {
+            fft_len = atol(argv[++i]);
+            hop = atol(argv[++i]);
+            if(!is_power_of_2(fft_len) || hop < 1 || hop > fft_len) die("the FFT length has to be a power of two, and the hop between 1 and that!\n");
+        } else if(i+1 < argc && strcmp(argv[i], "-j") == 0) {
+            nr_threads = atoi(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-D") == 0) {
+            dpi = atof(argv[++i]);
+        } else if(file_name == NULL) {
+            file_name = argv[i];
+        } else {
+            die("usage: tty-snd-specimg out.bmp [-w columns] [-l min-Hz] [-u max-Hz] [-d range-dB] [-F] [-T fft-length hop] [-j threads] [-D dpi]\n");
+        }
+    }
+    if(file_name == NULL) die("usage: tty-snd-specimg out.bmp [-w columns] [-l min-Hz] [-u max-Hz] [-d range-dB] [-F] [-T fft-length hop] [-j threads] [-D dpi]\n");
+    assert(columns >= 0 && min_hz > 0 && range_db > 0 && dpi > 0);
+    if(nr_threads < 1) nr_threads = 1;
+    if(nr_threads > MAX_THREADS) nr_threads = MAX_THREADS;
+
+    specimg_t img = {0};
+    img.min_hz = min_hz;
+    img.range_db = range_db;
+    img.fft_len = fft_len;
+    img.hop = hop;
+    for(int l = 0; l < SPECIMG_LEVELS; l++) {
+        heat_color((double) l/(SPECIMG_LEVELS-1), &img.colors[l][2], &img.colors[l][1], &img.colors[l][0]);
+    }
+    if(fft_len > 0) {
+        img.nr_bins = fft_len/2+1;
+        /* a full scale sine under the Hann window has the magnitude fft_len/4 */
+        img.power_scale = 16.0f/((float) fft_len*fft_len);
+        img.samples = calloc((SPECIMG_STRIP_ROWS-1)*hop + fft_len, sizeof(float));
+        img.window = malloc(fft_len*sizeof(float));
+        for(size_t i = 0; i < fft_len; i++) {
+            img.window[i] = 0.5f - 0.5f*cosf(2*M_PI*i/fft_len);
+        }
+        for(int t = 0; t < nr_threads; t++) {
+            img.spectrum[t] = malloc(2*fft_len*sizeof(float));
+            img.work[t] = malloc(fft_batch_work_size(2*fft_len)*sizeof(float));
+            img.thread_power[t] = malloc(img.nr_bins*sizeof(float));
+        }
+    }
+
+    bitmap_stream_t bmp;
+    size_t remaining = 0;
+    float rate = 0.0f;
+    bool started = false;
+    while(read_specimg_strip(&img, &remaining, &rate) > 0) {
+        if(!started) {
+            /* the binning once, now the rate and the size of the spectra are known */
+            started = true;
+            double nyquist = rate/2.0;
+            img.max_hz = (max_hz > 0.0 && max_hz < nyquist) ? max_hz : nyquist;
+            if(img.max_hz <= min_hz) die("the frequency range is empty!\n");
+            double bin_hz = rate/(2*(img.nr_bins-1));
+            if(columns == 0) {
+                /* a column per bin in the range, at most 1024 */
+                long nr_in_range = lround(img.max_hz/bin_hz) - lround(min_hz/bin_hz);
+                columns = (nr_in_range < 1) ? 1 : (nr_in_range > 1024) ? 1024 : (int) nr_in_range;
+            }
+            img.columns = columns;
+            img.column_bins = malloc((columns+1)*sizeof(size_t));
+            log_column_bins(img.column_bins, columns, min_hz, img.max_hz, bin_hz, img.nr_bins);
+            img.row_size = bitmap_row_size(columns, false);
+            img.rows = calloc(SPECIMG_STRIP_ROWS, img.row_size);
+            open_bitmap_stream(&bmp, file_name, columns, false, dpi);
+        }
+
+        size_t nr_tiles = (img.nr_rows + SPECIMG_TILE_ROWS-1)/SPECIMG_TILE_ROWS;
+        if(!full_scale && img.tile_max == NULL) {
+            /* 0 dB is the loudest bin of the first strip, which costs the analysis of a strip more */
+            img.tile_max = calloc(nr_tiles, sizeof(float));
+            parallel_for(nr_tiles, nr_threads, measure_specimg_tile, &img);
+            float max = 0.0f;
+            for(size_t t = 0; t < nr_tiles; t++) {
+                if(img.tile_max[t] > max) max = img.tile_max[t];
+            }
+            img.power_scale = (max > 0.0f) ? 1.0f/max : 1.0f;
+        }
+        parallel_for(nr_tiles, nr_threads, render_specimg_tile, &img);
+        write_bitmap_rows(&bmp, img.rows, (int) img.nr_rows);
+
+        if(fft_len > 0) {
+            size_t overlap = fft_len - hop;
+            memmove(img.samples, &img.samples[img.nr_rows*hop], overlap*sizeof(float));
+        }
+    }
+    if(!started) die("no spectra in the input!\n");
+    fprintf(stderr, "%i x %i spectrogram written\n", bmp.width, bmp.height);
+    close_bitmap_stream(&bmp);
+
+    for(int t = 0; t < MAX_THREADS; t++) {
+        free(img.spectrum[t]);
+        free(img.work[t]);
+        free(img.thread_power[t]);
+    }
+    free(img.column_bins);
+    free(img.tile_max);
+    free(img.rows);
+    free(img.power);
+    free(img.samples);
+    free(img.window);
+
+    return 0;
+}
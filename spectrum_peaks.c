@@ -0,0 +1,98 @@
+#include "common.h"
+
+/*
+ * The peak picking of tty-snd-peaks as a function: the magnitude spectrum is normalized,
+ * cut into intervals at falling cutoffs (cutoff_intervals.c), every interval becomes a peak at
+ * its centre frequency, peaks closer than min_cents_difference are merged into the higher one
+ * and the survivors are numbered by height (formant_nr 0 is the highest).
+ *
+ * The finder keeps the magnitude buffer and the range query tree, so calling it for spectrum
+ * after spectrum only allocates the interval and peak lists.
+ */
+
+peak_finder_t create_peak_finder(size_t max_len) {
+    peak_finder_t finder = {0};
+    finder.max_len = max_len;
+    finder.magnitudes = malloc(max_len*sizeof(float));
+    if(finder.magnitudes == NULL) die("out of memory for peak finder!\n");
+    finder.rq = create_range_query(max_len);
+    return finder;
+}
+
+void destroy_peak_finder(peak_finder_t* finder) {
+    free(finder[0].magnitudes);
+    finder[0].magnitudes = NULL;
+    destroy_range_query(&finder[0].rq);
+    finder[0].max_len = 0;
+}
+
+/* spectrum holds len complex values; returns the number of peaks, sorted by frequency. Merged
+   peaks stay in the list with freq == -1, the way tty-snd-peaks writes them out */
+size_t find_spectrum_peaks(peak_finder_t* finder, const float* spectrum, size_t len, float frequency, float cutoff_step, int min_cents_difference, peak_t** peaks_out) {
+    assert(len <= finder[0].max_len);
+    float* magnitudes = finder[0].magnitudes;
+    float max_magnitude = 0.0f;
+    for(size_t i = 0; i < len; i++) {
+        magnitudes[i] = sqrtf(spectrum[2*i]*spectrum[2*i] + spectrum[2*i+1]*spectrum[2*i+1]);
+        if(magnitudes[i] > max_magnitude) max_magnitude = magnitudes[i];
+    }
+    for(size_t i = 0; i < len; i++) {
+        magnitudes[i] /= max_magnitude;
+    }
+
+    interval_t* intervals;
+    size_t nr_intervals;
+    get_sorted_iteratively_merged_interval_list_by_cutoff_step(magnitudes, len/2, cutoff_step, &intervals, &nr_intervals);
+
+    peak_t* peaks = calloc(nr_intervals, sizeof(peak_t));
+    size_t nr_peaks = nr_intervals;
+
+    for(size_t i = 0; i < nr_intervals; i++) {
+        peaks[i].underlying_interval = intervals[i];
+        float upper_frequency_in_herz = frequency * (((float)intervals[i].upper_index)/((float) len));
+        float lower_frequency_in_herz = frequency * (((float)intervals[i].lower_index)/((float) len));
+        peaks[i].freq = (lower_frequency_in_herz + upper_frequency_in_herz) / 2;
+        peaks[i].height = 0.0f;
+        for(size_t j = intervals[i].lower_index; j < intervals[i].upper_index; j++) {
+            if(peaks[i].height < magnitudes[j])
+                peaks[i].height = magnitudes[j];
+        }
+        peaks[i].merged_peaks = 0;
+    }
+    free(intervals);
+    qsort(peaks, nr_peaks, sizeof(peak_t), peak_by_freq_cmp_qsort);
+
+    build_range_query(&finder[0].rq, magnitudes, len);
+    compute_rolloff_velocities(&finder[0].rq, peaks, nr_peaks);
+
+    for(size_t i = 0; i+1 < nr_peaks; i++) {
+        float curr_freq = peaks[i].freq;
+        float next_freq = peaks[i+1].freq;
+        float curr_height = peaks[i].height;
+        float next_height = peaks[i+1].height;
+        float distance = hz_to_octave(next_freq)-hz_to_octave(curr_freq);
+        float cents = distance*12*100;
+        bool should_be_merged = (cents < min_cents_difference);
+
+        if(should_be_merged) {
+            if(curr_height > next_height) {
+                peaks[i+1] = peaks[i];
+            }
+            peaks[i+1].merged_peaks++;
+            peaks[i].freq = -1.0f;
+        }
+    }
+
+    qsort(peaks, nr_peaks, sizeof(peak_t), peak_by_height_cmp_qsort);
+    int nr = 0;
+    for(long i = (long) nr_peaks-1; i >= 0; i--) {
+        if(peaks[i].freq == -1.0f) continue;
+        peaks[i].formant_nr = nr;
+        nr++;
+    }
+
+    qsort(peaks, nr_peaks, sizeof(peak_t), peak_by_freq_cmp_qsort);
+
+    peaks_out[0] = peaks;
+    return nr_peaks;
+}
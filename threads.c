@@ -0,0 +1,71 @@
+#include "common.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+/*
+ * Minimal thread pool for the analysis stages: nr_jobs independent jobs are handed out
+ * through a shared atomic counter, so a thread that finishes early just takes the next job
+ * and uneven jobs balance themselves. The job gets the number of the thread running it, so
+ * callers can keep one workspace per thread in an array indexed by it.
+ */
+
+typedef struct parallel_for_state_t {
+    atomic_size_t next_job;
+    size_t nr_jobs;
+    parallel_job_t job;
+    void* ctx;
+} parallel_for_state_t;
+
+typedef struct parallel_for_thread_t {
+    parallel_for_state_t* state;
+    int thread_nr;
+} parallel_for_thread_t;
+
+static void* parallel_for_worker(void* arg) {
+    parallel_for_thread_t* thread = arg;
+    parallel_for_state_t* state = thread[0].state;
+    while(true) {
+        size_t job_nr = atomic_fetch_add(&state[0].next_job, 1);
+        if(job_nr >= state[0].nr_jobs) break;
+        state[0].job(state[0].ctx, thread[0].thread_nr, job_nr);
+    }
+    return NULL;
+}
+
+int default_thread_count(void) {
+    long nr = sysconf(_SC_NPROCESSORS_ONLN);
+    if(nr < 1) return 1;
+    if(nr > MAX_THREADS) return MAX_THREADS;
+    return (int) nr;
+}
+
+void parallel_for(size_t nr_jobs, int nr_threads, parallel_job_t job, void* ctx) {
+    if(nr_threads < 1) nr_threads = 1;
+    if(nr_threads > MAX_THREADS) nr_threads = MAX_THREADS;
+    if((size_t) nr_threads > nr_jobs) nr_threads = (nr_jobs > 0) ? (int) nr_jobs : 1;
+
+    parallel_for_state_t state;
+    atomic_init(&state.next_job, 0);
+    state.nr_jobs = nr_jobs;
+    state.job = job;
+    state.ctx = ctx;
+
+    parallel_for_thread_t threads[MAX_THREADS];
+    pthread_t handles[MAX_THREADS];
+    for(int t = 0; t < nr_threads; t++) {
+        threads[t].state = &state;
+        threads[t].thread_nr = t;
+    }
+    /* the calling thread works as thread 0 */
+    int started = 1;
+    for(int t = 1; t < nr_threads; t++) {
+        if(pthread_create(&handles[t], NULL, parallel_for_worker, &threads[t]) != 0) break;
+        started++;
+    }
+    parallel_for_worker(&threads[0]);
+    for(int t = 1; t < started; t++) {
+        pthread_join(handles[t], NULL);
+    }
+}
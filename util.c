@@ -200,6 +200,42 @@ void die(const char* str) {
 	fprintf(stderr, str);
 	exit(EXIT_FAILURE);
 }
+/* seconds on a clock that only moves forward, for measuring durations */
+double monotonic_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec*1e-9;
+}
+/* columns+1 bin boundaries of log spaced columns from min_hz to max_hz, over nr_bins bins of bin_hz:
+   column c starts at the bin nearest to its frequency and reads up to column_bin_end. The low
+   columns can be narrower than a bin; neighbours then share the bin they are in, so every column
+   stays at the frequency its label says */
+void log_column_bins(size_t* column_bins, int columns, double min_hz, double max_hz, double bin_hz, size_t nr_bins) {
+    for(int c = 0; c <= columns; c++) {
+        double hz = min_hz*pow(max_hz/min_hz, (double) c/columns);
+        column_bins[c] = (size_t) lround(hz/bin_hz);
+        if(column_bins[c] > nr_bins-1) column_bins[c] = nr_bins-1;
+    }
+}
+/* the end of the bins of column c: the start of the next column, but at least one bin */
+size_t column_bin_end(const size_t* column_bins, int c) {
+    return (column_bins[c+1] > column_bins[c]) ? column_bins[c+1] : column_bins[c]+1;
+}
+/* a short axis label for a frequency: "440", "1.25k" */
+void format_frequency(char* out, size_t size, double hz) {
+    if(hz >= 1000.0) snprintf(out, size, "%.3gk", hz/1000.0);
+    else snprintf(out, size, "%.0f", hz);
+}
+/* the color map of the spectrograms, dark blue over red and orange to pale yellow for x from 0 to 1 */
+void heat_color(double x, uint8_t* r, uint8_t* g, uint8_t* b) {
+    static const double keys[5][3] = {{0, 0, 4}, {87, 16, 110}, {188, 55, 84}, {249, 142, 9}, {252, 255, 164}};
+    double pos = clamp(x, 0.0f, 1.0f)*4;
+    int i = (pos >= 4) ? 3 : (int) pos;
+    double t = pos - i;
+    r[0] = (uint8_t) lround(keys[i][0] + t*(keys[i+1][0] - keys[i][0]));
+    g[0] = (uint8_t) lround(keys[i][1] + t*(keys[i+1][1] - keys[i][1]));
+    b[0] = (uint8_t) lround(keys[i][2] + t*(keys[i+1][2] - keys[i][2]));
+}
 bool is_power_of_2(uint32_t x) {
     return x > 0 && !(x & (x-1));
 }
@@ -384,7 +420,7 @@ void debug_peaks(peak_t* peaks, size_t nr_peaks) {
                     if(peaks[i].height > finfos[j-1].max_amp) {
                         finfos[j-1].max_amp = peaks[i].height;
                     }
-                    if(peaks[i].formant_nr < finfos[i].lowest_formant) {
+                    if(peaks[i].formant_nr < finfos[j-1].lowest_formant) {
                         finfos[j-1].lowest_formant = peaks[i].formant_nr;
                     }
                     finfos[j-1].highest_harmonic++;
@@ -0,0 +1,217 @@
+#include "common.h"
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+/* tty-snd-waterfall:
+        shows a series of spectra as a scrolling spectrogram in the terminal: frequency on log
+        spaced columns from left to right, time from top to bottom, the magnitude in 24 bit color
+
+        tty-snd-waterfall [-w columns] [-l min-Hz] [-u max-Hz] [-d range-dB] [-T fft-length hop]
+
+        -w columns        width (default: the width of the terminal)
+        -l, -u Hz         frequency range (default 50 to 8000)
+        -d dB             dynamic range below the loudest bin so far (default 80)
+        -T frames hop     the input is a sound stream, such as the chunks of tty-snd-mic-src stream:
+                          run a Hann windowed FFT of fft-length every hop frames over its real parts.
+                          Without -T every stream on stdin is one spectrum, as tty-snd-fft writes it
+
+        A character cell is an upper half block, its foreground the color of one spectrum and its
+        background the color of the next, so a line holds two spectra and the pixels are about
+        square. The waterfall scrolls by writing only the new line, with a color escape only
+        where the color changes, and the bins of every column are found once for the size and
+        rate of the spectra, so it keeps up with spectra at a few hundred frames per second.
+*/
+
+#define WATERFALL_LEVELS 64
+
+typedef struct waterfall_t {
+    int columns;
+    double min_hz, max_hz, range_db;
+    size_t nr_bins;             /* the binning is for spectra of nr_bins bins of bin_hz; 0 before the first */
+    double bin_hz;
+    size_t* column_bins;        /* columns+1 bin boundaries */
+    float max_power;            /* the loudest bin so far is 0 dB */
+    uint8_t* upper;             /* the levels of the spectrum waiting for the next one */
+    bool has_upper;
+    char fg[WATERFALL_LEVELS][24], bg[WATERFALL_LEVELS][24];
+    char* line;
+} waterfall_t;
+
+static void init_waterfall(waterfall_t* wf, int columns, double min_hz, double max_hz, double range_db) {
+    memset(wf, 0, sizeof(waterfall_t));
+    wf[0].columns = columns;
+    wf[0].min_hz = min_hz;
+    wf[0].max_hz = max_hz;
+    wf[0].range_db = range_db;
+    wf[0].column_bins = malloc((columns+1)*sizeof(size_t));
+    wf[0].upper = malloc(columns);
+    /* the worst case: both colors change in every cell */
+    wf[0].line = malloc(columns*(2*24 + 3) + 16);
+    for(int l = 0; l < WATERFALL_LEVELS; l++) {
+        uint8_t r, g, b;
+        heat_color((double) l/(WATERFALL_LEVELS-1), &r, &g, &b);
+        snprintf(wf[0].fg[l], sizeof(wf[0].fg[l]), "\x1b[38;2;%i;%i;%im", r, g, b);
+        snprintf(wf[0].bg[l], sizeof(wf[0].bg[l]), "\x1b[48;2;%i;%i;%im", r, g, b);
+    }
+}
+
+static void destroy_waterfall(waterfall_t* wf) {
+    free(wf[0].column_bins);
+    free(wf[0].upper);
+    free(wf[0].line);
+}
+
+static void bin_waterfall_columns(waterfall_t* wf, size_t nr_bins, double bin_hz) {
+    wf[0].nr_bins = nr_bins;
+    wf[0].bin_hz = bin_hz;
+    log_column_bins(wf[0].column_bins, wf[0].columns, wf[0].min_hz, wf[0].max_hz, bin_hz, nr_bins);
+}
+
+/* writes the line of upper and lower levels; lower NULL leaves the lower halves empty */
+static void write_waterfall_line(waterfall_t* wf, const uint8_t* upper, const uint8_t* lower) {
+    char* out = wf[0].line;
+    int fg = -1, bg = -1;
+    if(lower == NULL) {
+        strcpy(out, "\x1b[49m");
+        out += strlen(out);
+    }
+    for(int c = 0; c < wf[0].columns; c++) {
+        if(upper[c] != fg) {
+            fg = upper[c];
+            out = stpcpy(out, wf[0].fg[fg]);
+        }
+        if(lower != NULL && lower[c] != bg) {
+            bg = lower[c];
+            out = stpcpy(out, wf[0].bg[bg]);
+        }
+        out = stpcpy(out, "▀");
+    }
+    out = stpcpy(out, "\x1b[0m\n");
+    fwrite(wf[0].line, 1, out - wf[0].line, stdout);
+    fflush(stdout);
+}
+
+/* adds the next spectrum, power[k] of the bins k*bin_hz */
+static void waterfall_add(waterfall_t* wf, const float* power, size_t nr_bins, double bin_hz) {
+    if(nr_bins != wf[0].nr_bins || bin_hz != wf[0].bin_hz) bin_waterfall_columns(wf, nr_bins, bin_hz);
+
+    for(size_t k = 0; k < nr_bins; k++) {
+        if(power[k] > wf[0].max_power) wf[0].max_power = power[k];
+    }
+    if(wf[0].max_power == 0.0f) wf[0].max_power = 1.0f;
+
+    uint8_t levels[wf[0].columns];
+    uint8_t* target = wf[0].has_upper ? levels : wf[0].upper;
+    for(int c = 0; c < wf[0].columns; c++) {
+        float max = 0.0f;
+        for(size_t k = wf[0].column_bins[c]; k < column_bin_end(wf[0].column_bins, c); k++) {
+            if(power[k] > max) max = power[k];
+        }
+        double db = 10.0*log10(max/wf[0].max_power + 1e-30);
+        long level = lround((db + wf[0].range_db)/wf[0].range_db*(WATERFALL_LEVELS-1));
+        target[c] = (uint8_t)((level < 0) ? 0 : (level > WATERFALL_LEVELS-1) ? WATERFALL_LEVELS-1 : level);
+    }
+
+    if(wf[0].has_upper) write_waterfall_line(wf, wf[0].upper, levels);
+    wf[0].has_upper = !wf[0].has_upper;
+}
+
+int main(int argc, char** argv) {
+    int columns = 0;
+    double min_hz = 50.0, max_hz = 8000.0, range_db = 80.0;
+    size_t fft_len = 0, hop = 0;
+    for(int i = 1; i < argc; i++) {
+        if(i+1 < argc && strcmp(argv[i], "-w") == 0) {
+            columns = atoi(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-l") == 0) {
+            min_hz = atof(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-u") == 0) {
+            max_hz = atof(argv[++i]);
+        } else if(i+1 < argc && strcmp(argv[i], "-d") == 0) {
+            range_db = atof(argv[++i]);
+        } else if(i+2 < argc && strcmp(argv[i], "-T") == 0) {
+            fft_len = atol(argv[++i]);
+            hop = atol(argv[++i]);
+            if(!is_power_of_2(fft_len) || hop < 1 || hop > fft_len) die("the FFT length has to be a power of two, and the hop between 1 and that!\n");
+        } else {
+            die("usage: tty-snd-waterfall [-w columns] [-l min-Hz] [-u max-Hz] [-d range-dB] [-T fft-length hop]\n");
+        }
+    }
+    assert(min_hz > 0 && max_hz > min_hz && range_db > 0);
+    if(columns <= 0) {
+        struct winsize size;
+        columns = (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col > 1) ? size.ws_col-1 : 79;
+    }
+
+    waterfall_t wf;
+    init_waterfall(&wf, columns, min_hz, max_hz, range_db);
+
+    /* the frequency axis, once */
+    char axis[columns+16];
+    memset(axis, ' ', columns);
+    for(int c = 0; c < columns; c += 10) {
+        char label[16];
+        format_frequency(label, sizeof(label), min_hz*pow(max_hz/min_hz, (double) c/columns));
+        int len = snprintf(&axis[c], sizeof(axis)-c, "|%s", label);
+        if(c + len < columns) axis[c+len] = ' ';
+    }
+    axis[columns] = '\0';
+    printf("%s\n", axis);
+
+    if(fft_len == 0) {
+        simple_wav_t spectrum;
+        float* power = NULL;
+        size_t power_size = 0;
+        while(try_read_simple_wav(stdin, &spectrum)) {
+            size_t len = spectrum.nr_sample_points/2;
+            if(len < 2) die("a spectrum needs at least two bins!\n");
+            if(len/2+1 > power_size) {
+                power_size = len/2+1;
+                power = realloc(power, power_size*sizeof(float));
+            }
+            for(size_t k = 0; k <= len/2; k++) {
+                power[k] = spectrum.samples[2*k]*spectrum.samples[2*k] + spectrum.samples[2*k+1]*spectrum.samples[2*k+1];
+            }
+            waterfall_add(&wf, power, len/2+1, spectrum.frequency_in_hz/len);
+            free(spectrum.samples);
+            free(spectrum.peaks);
+        }
+        free(power);
+    } else {
+        float* history = calloc(fft_len, sizeof(float));
+        float* window = malloc(fft_len*sizeof(float));
+        float* spectrum = malloc(2*fft_len*sizeof(float));
+        float* work = malloc(fft_batch_work_size(2*fft_len)*sizeof(float));
+        float* power = malloc((fft_len/2+1)*sizeof(float));
+        for(size_t i = 0; i < fft_len; i++) {
+            window[i] = 0.5f - 0.5f*cosf(2*M_PI*i/fft_len);
+        }
+        size_t remaining = 0;
+        float rate = 0.0f;
+        while(true) {
+            memmove(history, &history[hop], (fft_len-hop)*sizeof(float));
+            size_t nr = read_stream_real_parts(stdin, &remaining, &rate, &history[fft_len-hop], hop);
+            if(nr < hop) break;
+            for(size_t i = 0; i < fft_len; i++) {
+                spectrum[2*i] = window[i]*history[i];
+                spectrum[2*i+1] = 0.0f;
+            }
+            fft_power_of_two_batch_f(spectrum, spectrum, 2*fft_len, 1, false, work);
+            for(size_t k = 0; k <= fft_len/2; k++) {
+                power[k] = spectrum[2*k]*spectrum[2*k] + spectrum[2*k+1]*spectrum[2*k+1];
+            }
+            waterfall_add(&wf, power, fft_len/2+1, rate/fft_len);
+        }
+        free(history);
+        free(window);
+        free(spectrum);
+        free(work);
+        free(power);
+    }
+
+    /* an odd spectrum at the end gets a line of its own */
+    if(wf.has_upper) write_waterfall_line(&wf, wf.upper, NULL);
+    destroy_waterfall(&wf);
+
+    return 0;
+}